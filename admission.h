@@ -0,0 +1,153 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace cache
+{
+// LRUCache准入策略
+// 缓存分为窗口区和主区, 新条目先进入窗口区; 窗口区溢出的条目作为候选者, 主区已满时与主区的淘汰者比较, 由Admit决定淘汰哪一个
+// 策略需提供: 构造函数(capacity), WindowCapacity(capacity), Record(hash), Admit(candidate_hash, victim_hash), 以及Enabled常量
+
+// 不做准入过滤: 窗口区即整个缓存, 等价于普通LRU
+struct NoAdmission
+{
+    static constexpr bool Enabled = false;
+
+    explicit NoAdmission(size_t)
+    {
+    }
+
+    static size_t WindowCapacity(size_t capacity)
+    {
+        return capacity;
+    }
+
+    void Record(size_t)
+    {
+    }
+
+    bool Admit(size_t, size_t)
+    {
+        return true;
+    }
+};
+
+// W-TinyLFU: 窗口区占容量的1%, 主区为分段LRU(试用区 + 占主区80%的保护区)
+// 访问频率用4行4位计数的Count-Min Sketch估计, 记录次数达到计数器数量的10倍时所有计数减半, 让旧的热点逐渐冷却
+// 候选者的估计频率高于淘汰者才被接纳, 只访问一次的key不会挤掉高频条目
+class TinyLFUAdmission
+{
+public:
+    static constexpr bool Enabled = true;
+
+    explicit TinyLFUAdmission(size_t capacity)
+    :
+    _additions(0)
+    {
+        //每行计数器数量取不小于容量的2的幂, 每个uint64_t存16个计数器
+        size_t width = 16;
+        while (width < capacity && width < MaxWidth)
+        {
+            width <<= 1;
+        }
+        this->_mask = width - 1;
+        this->_words = width / 16;
+        this->_table.assign(this->_words * Depth, 0);
+        this->_sample_size = width * 10;
+    }
+
+    static size_t WindowCapacity(size_t capacity)
+    {
+        auto window = capacity / 100;
+        return window > 0 ? window : 1;
+    }
+
+    void Record(size_t hash)
+    {
+        auto h = spread(hash);
+        bool added = false;
+        for (size_t row = 0; row < Depth; ++row)
+        {
+            added = this->increment(row, this->index(h, row)) || added;
+        }
+        if (added && ++this->_additions >= this->_sample_size)
+        {
+            this->reset();
+        }
+    }
+
+    bool Admit(size_t candidate, size_t victim)
+    {
+        return this->Frequency(candidate) > this->Frequency(victim);
+    }
+
+    uint32_t Frequency(size_t hash) const
+    {
+        auto h = spread(hash);
+        uint32_t frequency = MaxCount;
+        for (size_t row = 0; row < Depth; ++row)
+        {
+            auto count = this->count(row, this->index(h, row));
+            frequency = count < frequency ? count : frequency;
+        }
+        return frequency;
+    }
+
+private:
+    static const size_t Depth = 4;
+    static const uint32_t MaxCount = 15;
+    static const size_t MaxWidth = 1 << 22;     //容量按权重限制时条目数上限可能很大, 计数表最多占8MB
+
+    //std::hash对整数是恒等映射, 先混淆
+    static uint64_t spread(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    size_t index(uint64_t hash, size_t row) const
+    {
+        static const uint64_t seeds[Depth] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+        auto h = (hash + seeds[row]) * seeds[row];
+        h += h >> 32;
+        return static_cast<size_t>(h) & this->_mask;
+    }
+
+    uint32_t count(size_t row, size_t index) const
+    {
+        auto word = this->_table[row * this->_words + index / 16];
+        return static_cast<uint32_t>((word >> ((index % 16) * 4)) & 0xF);
+    }
+
+    bool increment(size_t row, size_t index)
+    {
+        auto &word = this->_table[row * this->_words + index / 16];
+        auto shift = (index % 16) * 4;
+        if (((word >> shift) & 0xF) == MaxCount)
+        {
+            return false;
+        }
+        word += 1ULL << shift;
+        return true;
+    }
+
+    //所有计数减半
+    void reset()
+    {
+        for (auto &word : this->_table)
+        {
+            word = (word >> 1) & 0x7777777777777777ULL;
+        }
+        this->_additions /= 2;
+    }
+
+    size_t                  _mask;
+    size_t                  _words;         //每行的uint64_t数量
+    size_t                  _sample_size;
+    size_t                  _additions;
+    std::vector<uint64_t>   _table;
+};
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace cache
+{
+// 批量异步投递: 条目先进入缓冲区, 攒满batch_size或最早的条目等待超过linger后整批交给工作线程回调
+// 回调只在工作线程上执行, 慢回调不会阻塞调用方; 析构时投递完剩余条目
+// 缓冲区最多max_pending条, 回调跟不上时丢弃新条目并计数, 不阻塞调用方(过期清理线程由所有缓存共用)
+template<class T>
+class BatchDelivery
+{
+public:
+    using OnBatch = std::function<void(const std::vector<T> &batch)>;
+    static const size_t DefaultMaxPending = 65536;
+
+    BatchDelivery(const OnBatch &on_batch, size_t batch_size, std::chrono::milliseconds linger, size_t workers = 1,
+                  size_t max_pending = DefaultMaxPending)
+    :
+    _on_batch(on_batch),
+    _batch_size(batch_size > 0 ? batch_size : 1),
+    _max_pending(max_pending > 0 ? max_pending : 1),
+    _linger(linger),
+    _stopped(false),
+    _dropped(0)
+    {
+        if (workers == 0)
+        {
+            workers = 1;
+        }
+        for (size_t i = 0; i < workers; ++i)
+        {
+            this->_workers.emplace_back(&BatchDelivery::run, this);
+        }
+    }
+
+    ~BatchDelivery()
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_stopped = true;
+            this->_condition.notify_all();
+        }
+        for (auto &worker : this->_workers)
+        {
+            worker.join();
+        }
+    }
+
+    BatchDelivery(const BatchDelivery&) = delete;
+    BatchDelivery& operator=(const BatchDelivery&) = delete;
+
+    //取走items中的全部条目, 缓冲区已满时丢弃超出的部分, 返回丢弃的条数
+    size_t Push(std::vector<T> &items)
+    {
+        if (items.empty())
+        {
+            return 0;
+        }
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        auto was_empty = this->_buffer.empty();
+        if (was_empty)
+        {
+            this->_first = std::chrono::steady_clock::now();
+        }
+        auto room = this->_max_pending - this->_buffer.size();
+        auto accepted = items.size() < room ? items.size() : room;
+        for (size_t i = 0; i < accepted; ++i)
+        {
+            this->_buffer.emplace_back(std::move(items[i]));
+        }
+        auto dropped = items.size() - accepted;
+        this->_dropped += dropped;
+        items.clear();
+        //缓冲区从空变为非空时唤醒一个线程开始计时, 攒满一批时立即投递
+        if (accepted > 0 && (was_empty || this->_buffer.size() >= this->_batch_size))
+        {
+            this->_condition.notify_one();
+        }
+        return dropped;
+    }
+
+    //缓冲区已满而丢弃的累计条数
+    size_t Dropped()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        return this->_dropped;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (true)
+        {
+            if (this->_buffer.empty())
+            {
+                if (this->_stopped)
+                {
+                    return;
+                }
+                this->_condition.wait(lock);
+                continue;
+            }
+            if (!this->_stopped && this->_buffer.size() < this->_batch_size)
+            {
+                auto deadline = this->_first + this->_linger;
+                if (std::chrono::steady_clock::now() < deadline)
+                {
+                    this->_condition.wait_until(lock, deadline);
+                    continue;
+                }
+            }
+            std::vector<T> batch;
+            batch.reserve(this->_buffer.size() < this->_batch_size ? this->_buffer.size() : this->_batch_size);
+            while (!this->_buffer.empty() && batch.size() < this->_batch_size)
+            {
+                batch.emplace_back(std::move(this->_buffer.front()));
+                this->_buffer.pop_front();
+            }
+            //剩下的条目重新计时, 攒满一批的交给其他空闲线程
+            this->_first = std::chrono::steady_clock::now();
+            if (this->_buffer.size() >= this->_batch_size)
+            {
+                this->_condition.notify_one();
+            }
+            lock.unlock();
+            this->_on_batch(batch);
+            lock.lock();
+        }
+    }
+
+    OnBatch                                 _on_batch;
+    size_t                                  _batch_size;
+    size_t                                  _max_pending;
+    std::chrono::milliseconds               _linger;
+    bool                                    _stopped;
+    size_t                                  _dropped;
+    std::chrono::steady_clock::time_point   _first;     //缓冲区中最早条目的入队时间
+    std::deque<T>                           _buffer;
+    std::mutex                              _mutex;
+    std::condition_variable                 _condition;
+    std::vector<std::thread>                _workers;
+};
+}
@@ -0,0 +1,381 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "local_cache.h"
+
+namespace serialize
+{
+template<class T>
+class JsonSerializer;
+}
+
+namespace cache
+{
+// 快照编解码: 平凡可拷贝类型按内存直接拷贝, std::string按原始字节,
+// 其他类型走反射JSON序列化(需要包含json_serialize.h并用REGIST_MEMBER_JSON注册)
+// 数据无法解码时Decode抛出异常, CacheSnapshot::Load据此返回false
+template<class T, class = void>
+struct SnapshotCodec
+{
+    static void Encode(const T &value, std::string &out)
+    {
+        out += serialize::JsonSerializer<T>::ToString(value);
+    }
+
+    static T Decode(const char *data, size_t size)
+    {
+        return serialize::JsonSerializer<T>::FromString(std::string(data, size));
+    }
+};
+
+template<class T>
+struct SnapshotCodec<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type>
+{
+    static void Encode(const T &value, std::string &out)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    //长度不符说明快照被截断或损坏, 不能只拷贝一部分
+    static T Decode(const char *data, size_t size)
+    {
+        if (size != sizeof(T))
+        {
+            throw std::invalid_argument("Snapshot field size mismatch");
+        }
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+};
+
+template<>
+struct SnapshotCodec<std::string>
+{
+    static void Encode(const std::string &value, std::string &out)
+    {
+        out += value;
+    }
+
+    static std::string Decode(const char *data, size_t size)
+    {
+        return std::string(data, size);
+    }
+};
+
+// 缓存快照文件, 用于进程重启后快速预热
+// 文件格式(本机字节序):
+//   头部: magic(8) + version(4) + segment_count(4)
+//   段表: segment_count * {offset(8), length(8), count(8)}
+//   段数据: count * {key_len(4), key, value_len(4), value}
+// 分片缓存每个分片写一个段, 加载时各段并行解码, 全部解码成功后才写入缓存
+template<class K, class V, class KeyCodec = SnapshotCodec<K>, class ValueCodec = SnapshotCodec<V>>
+class CacheSnapshot
+{
+public:
+    template<class Storage, class Holder>
+    static bool Save(LocalCache<K, V, Storage, Holder> &cache, const std::string &path)
+    {
+        std::vector<std::string> segments(1);
+        std::vector<uint64_t> counts(1);
+        counts[0] = encode(cache, segments[0]);
+        return write(path, segments, counts);
+    }
+
+    template<class Storage, class Holder>
+    static bool Save(ShardedLocalCache<K, V, Storage, Holder> &cache, const std::string &path)
+    {
+        auto shard_count = cache.ShardCount();
+        std::vector<std::string> segments(shard_count);
+        std::vector<uint64_t> counts(shard_count);
+        std::vector<std::future<void>> tasks;
+        for (size_t i = 0; i < shard_count; ++i)
+        {
+            tasks.emplace_back(std::async(std::launch::async, [&, i]()
+            {
+                counts[i] = encode(cache.GetShard(i), segments[i]);
+            }));
+        }
+        for (auto &task : tasks)
+        {
+            task.get();
+        }
+        return write(path, segments, counts);
+    }
+
+    //已存在的key保留缓存中的值; 文件不存在或格式错误返回false, 此时缓存保持不变
+    template<class Cache>
+    static bool Load(Cache &cache, const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HeaderSize))
+        {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+        {
+            return false;
+        }
+        ::madvise(addr, size, MADV_WILLNEED);
+        auto ok = load(cache, static_cast<const char *>(addr), size);
+        ::munmap(addr, size);
+        return ok;
+    }
+
+private:
+    static constexpr const char *Magic = "ECSNAP01";
+    static const uint32_t Version = 1;
+    static const size_t HeaderSize = 16;
+    static const size_t SegmentEntrySize = 24;
+    static const size_t LoadBatchSize = 4096;
+
+    struct Segment
+    {
+        uint64_t offset;
+        uint64_t length;
+        uint64_t count;
+    };
+
+    template<class T>
+    static void append(std::string &out, T value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<class T>
+    static T read(const char *data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    //分块遍历编码, 不复制整张表
+    template<class Storage, class Holder>
+    static uint64_t encode(LocalCache<K, V, Storage, Holder> &cache, std::string &out)
+    {
+        uint64_t count = 0;
+        cache.Scan([&](const K &key, const typename LocalCache<K, V, Storage, Holder>::Value &value)
+        {
+            auto address = value_address(value);
+            if (!address)
+            {
+                return true;
+            }
+            encode_field<KeyCodec>(key, out);
+            encode_field<ValueCodec>(*address, out);
+            count++;
+            return true;
+        });
+        return count;
+    }
+
+    //兼容两种值持有策略: shared_ptr可能为空, 内联值总是存在
+    static const V *value_address(const std::shared_ptr<V> &value)
+    {
+        return value.get();
+    }
+
+    static const V *value_address(const V &value)
+    {
+        return &value;
+    }
+
+    template<class Value>
+    static Value decode_value(const char *data, size_t size)
+    {
+        if constexpr (std::is_same<Value, std::shared_ptr<V>>::value)
+        {
+            return std::make_shared<V>(ValueCodec::Decode(data, size));
+        }
+        else
+        {
+            return ValueCodec::Decode(data, size);
+        }
+    }
+
+    //先写长度占位, 编码后回填, 避免中间拷贝
+    template<class Codec, class T>
+    static void encode_field(const T &value, std::string &out)
+    {
+        auto pos = out.size();
+        append<uint32_t>(out, 0);
+        Codec::Encode(value, out);
+        auto length = static_cast<uint32_t>(out.size() - pos - sizeof(uint32_t));
+        std::memcpy(&out[pos], &length, sizeof(length));
+    }
+
+    //先写临时文件再rename, 保证快照文件始终完整
+    static bool write(const std::string &path, const std::vector<std::string> &segments, const std::vector<uint64_t> &counts)
+    {
+        std::string header(Magic, 8);
+        append<uint32_t>(header, Version);
+        append<uint32_t>(header, static_cast<uint32_t>(segments.size()));
+        uint64_t offset = HeaderSize + SegmentEntrySize * segments.size();
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            append<uint64_t>(header, offset);
+            append<uint64_t>(header, segments[i].size());
+            append<uint64_t>(header, counts[i]);
+            offset += segments[i].size();
+        }
+
+        auto tmp = path + ".tmp";
+        FILE *file = std::fopen(tmp.c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+        bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+        for (auto &segment : segments)
+        {
+            ok = ok && std::fwrite(segment.data(), 1, segment.size(), file) == segment.size();
+        }
+        ok = ok && std::fflush(file) == 0 && ::fsync(::fileno(file)) == 0;
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    template<class Cache>
+    static bool load(Cache &cache, const char *data, size_t size)
+    {
+        if (std::memcmp(data, Magic, 8) != 0 || read<uint32_t>(data + 8) != Version)
+        {
+            return false;
+        }
+        //段表和各段都必须落在文件内, 且段数据不能与头部和段表重叠
+        auto segment_count = read<uint32_t>(data + 12);
+        if (segment_count > (size - HeaderSize) / SegmentEntrySize)
+        {
+            return false;
+        }
+        size_t table_end = HeaderSize + SegmentEntrySize * segment_count;
+        std::vector<Segment> segments(segment_count);
+        for (size_t i = 0; i < segment_count; ++i)
+        {
+            auto entry = data + HeaderSize + SegmentEntrySize * i;
+            segments[i] = {read<uint64_t>(entry), read<uint64_t>(entry + 8), read<uint64_t>(entry + 16)};
+            if (segments[i].offset < table_end || segments[i].offset > size || segments[i].length > size - segments[i].offset)
+            {
+                return false;
+            }
+        }
+
+        //先把各段并行解码到暂存区, 全部成功后再写入缓存, 损坏的快照不会留下部分数据
+        std::vector<std::vector<typename Cache::Item>> staged(segment_count);
+        std::vector<std::future<bool>> tasks;
+        for (size_t i = 0; i < segment_count; ++i)
+        {
+            tasks.emplace_back(std::async(std::launch::async, [&staged, data, &segments, i]()
+            {
+                return decode_segment(data + segments[i].offset, segments[i].length, segments[i].count, staged[i]);
+            }));
+        }
+        bool ok = true;
+        for (auto &task : tasks)
+        {
+            ok = task.get() && ok;
+        }
+        if (!ok)
+        {
+            return false;
+        }
+
+        //分批写入, 分片缓存的MultiPut会按分片合并加锁
+        std::vector<typename Cache::Item> batch;
+        batch.reserve(LoadBatchSize);
+        for (auto &items : staged)
+        {
+            for (auto &item : items)
+            {
+                batch.emplace_back(std::move(item));
+                if (batch.size() >= LoadBatchSize)
+                {
+                    cache.MultiPut(batch);
+                    batch.clear();
+                }
+            }
+            std::vector<typename Cache::Item>().swap(items);
+        }
+        if (!batch.empty())
+        {
+            cache.MultiPut(batch);
+        }
+        return true;
+    }
+
+    //记录数与段表中的count不符也视为损坏
+    template<class Item>
+    static bool decode_segment(const char *data, size_t size, uint64_t count, std::vector<Item> &items)
+    {
+        if (count > size / (2 * sizeof(uint32_t)))
+        {
+            return false;
+        }
+        items.reserve(count);
+        size_t pos = 0;
+        while (pos < size)
+        {
+            const char *key = nullptr;
+            const char *value = nullptr;
+            uint32_t key_length = 0;
+            uint32_t value_length = 0;
+            if (!next_field(data, size, pos, key, key_length) || !next_field(data, size, pos, value, value_length))
+            {
+                return false;
+            }
+            try
+            {
+                items.emplace_back(KeyCodec::Decode(key, key_length), decode_value<typename Item::second_type>(value, value_length));
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+        }
+        return items.size() == count;
+    }
+
+    static bool next_field(const char *data, size_t size, size_t &pos, const char *&field, uint32_t &length)
+    {
+        if (size - pos < sizeof(uint32_t))
+        {
+            return false;
+        }
+        length = read<uint32_t>(data + pos);
+        pos += sizeof(uint32_t);
+        if (size - pos < length)
+        {
+            return false;
+        }
+        field = data + pos;
+        pos += length;
+        return true;
+    }
+};
+}
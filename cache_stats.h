@@ -0,0 +1,228 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+
+namespace cache
+{
+// 加锁等待直方图分桶: 第0桶为无竞争(try_lock直接成功), 第1桶为128纳秒以内, 第i桶为[2^(i+5), 2^(i+6))纳秒, 最后一桶为溢出
+const size_t LockWaitBuckets = 16;
+
+// 缓存统计快照
+struct CacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t puts = 0;
+    uint64_t evictions = 0;
+    uint64_t expirations = 0;
+    uint64_t lock_waits = 0;                                //记录的加锁次数
+    uint64_t lock_wait_ns = 0;                              //发生竞争时的总等待时间
+    std::array<uint64_t, LockWaitBuckets> lock_wait_histogram = {};
+
+    double HitRatio() const
+    {
+        auto total = this->hits + this->misses;
+        return total == 0 ? 0.0 : static_cast<double>(this->hits) / total;
+    }
+
+    CacheStats &operator+=(const CacheStats &other)
+    {
+        this->hits += other.hits;
+        this->misses += other.misses;
+        this->puts += other.puts;
+        this->evictions += other.evictions;
+        this->expirations += other.expirations;
+        this->lock_waits += other.lock_waits;
+        this->lock_wait_ns += other.lock_wait_ns;
+        for (size_t i = 0; i < LockWaitBuckets; ++i)
+        {
+            this->lock_wait_histogram[i] += other.lock_wait_histogram[i];
+        }
+        return *this;
+    }
+};
+
+namespace detail
+{
+inline size_t thread_stripe(size_t stripes)
+{
+    static thread_local size_t hash = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return hash % stripes;
+}
+}
+
+// 缓存统计记录器, 默认关闭
+// 计数按线程分条到独立缓存行, 热路径只有一次relaxed自增; 加锁先try_lock, 只有发生竞争才读时钟
+// 计数单元在第一次开启时才分配, 未开启统计的缓存(及分片缓存的每个分片)只占两个原子变量
+class CacheStatsRecorder
+{
+public:
+    CacheStatsRecorder()
+    :
+    _enabled(false),
+    _cells(nullptr)
+    {
+    }
+
+    //关闭后保留已分配的计数单元, 重新开启时继续累加
+    ~CacheStatsRecorder()
+    {
+        delete[] this->_cells.load(std::memory_order_relaxed);
+    }
+
+    void Enable(bool enabled)
+    {
+        if (enabled && !this->_cells.load(std::memory_order_acquire))
+        {
+            //并发开启时只保留一份
+            Cell *expected = nullptr;
+            auto cells = new Cell[Stripes];
+            if (!this->_cells.compare_exchange_strong(expected, cells, std::memory_order_acq_rel))
+            {
+                delete[] cells;
+            }
+        }
+        this->_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool Enabled() const
+    {
+        return this->_enabled.load(std::memory_order_relaxed);
+    }
+
+    void Hit(uint64_t count = 1)
+    {
+        this->add(&Cell::hits, count);
+    }
+
+    void Miss(uint64_t count = 1)
+    {
+        this->add(&Cell::misses, count);
+    }
+
+    void Put(uint64_t count = 1)
+    {
+        this->add(&Cell::puts, count);
+    }
+
+    void Evict(uint64_t count = 1)
+    {
+        this->add(&Cell::evictions, count);
+    }
+
+    void Expire(uint64_t count = 1)
+    {
+        this->add(&Cell::expirations, count);
+    }
+
+    template<class Mutex>
+    std::shared_lock<Mutex> ReadLock(Mutex &mutex)
+    {
+        return this->lock<std::shared_lock<Mutex>>(mutex);
+    }
+
+    template<class Mutex>
+    std::unique_lock<Mutex> WriteLock(Mutex &mutex)
+    {
+        return this->lock<std::unique_lock<Mutex>>(mutex);
+    }
+
+    CacheStats Snapshot() const
+    {
+        CacheStats stats;
+        auto cells = this->_cells.load(std::memory_order_acquire);
+        if (!cells)
+        {
+            return stats;
+        }
+        for (size_t s = 0; s < Stripes; ++s)
+        {
+            auto &cell = cells[s];
+            stats.hits += cell.hits.load(std::memory_order_relaxed);
+            stats.misses += cell.misses.load(std::memory_order_relaxed);
+            stats.puts += cell.puts.load(std::memory_order_relaxed);
+            stats.evictions += cell.evictions.load(std::memory_order_relaxed);
+            stats.expirations += cell.expirations.load(std::memory_order_relaxed);
+            stats.lock_wait_ns += cell.lock_wait_ns.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < LockWaitBuckets; ++i)
+            {
+                auto count = cell.lock_waits[i].load(std::memory_order_relaxed);
+                stats.lock_wait_histogram[i] += count;
+                stats.lock_waits += count;
+            }
+        }
+        return stats;
+    }
+
+private:
+    static const size_t Stripes = 16;
+
+    struct alignas(64) Cell
+    {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> puts{0};
+        std::atomic<uint64_t> evictions{0};
+        std::atomic<uint64_t> expirations{0};
+        std::atomic<uint64_t> lock_wait_ns{0};
+        std::atomic<uint64_t> lock_waits[LockWaitBuckets] = {};
+    };
+
+    //未开启时返回空; 开启标记先于计数单元可见时同样按未开启处理
+    Cell *cell()
+    {
+        if (!this->Enabled())
+        {
+            return nullptr;
+        }
+        auto cells = this->_cells.load(std::memory_order_acquire);
+        return cells ? cells + detail::thread_stripe(Stripes) : nullptr;
+    }
+
+    void add(std::atomic<uint64_t> Cell::*counter, uint64_t count)
+    {
+        auto cell = this->cell();
+        if (!cell)
+        {
+            return;
+        }
+        (cell->*counter).fetch_add(count, std::memory_order_relaxed);
+    }
+
+    template<class Lock, class Mutex>
+    Lock lock(Mutex &mutex)
+    {
+        auto cell = this->cell();
+        if (!cell)
+        {
+            return Lock(mutex);
+        }
+        Lock lock(mutex, std::try_to_lock);
+        if (lock.owns_lock())
+        {
+            cell->lock_waits[0].fetch_add(1, std::memory_order_relaxed);
+            return lock;
+        }
+        auto start = std::chrono::steady_clock::now();
+        lock.lock();
+        auto wait = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        size_t bucket = 1;
+        while (bucket < LockWaitBuckets - 1 && (wait >> (bucket + 6)) != 0)
+        {
+            bucket++;
+        }
+        cell->lock_waits[bucket].fetch_add(1, std::memory_order_relaxed);
+        cell->lock_wait_ns.fetch_add(wait, std::memory_order_relaxed);
+        return lock;
+    }
+
+    std::atomic<bool>   _enabled;
+    std::atomic<Cell *> _cells;
+};
+}
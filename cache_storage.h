@@ -0,0 +1,184 @@
+#pragma once
+#include <memory>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <functional>
+#include <type_traits>
+#include "flat_hash_map.h"
+
+namespace cache
+{
+// 缓存默认的哈希与比较函数, std::string键支持用string_view/const char*直接查找
+template<class K>
+struct DefaultHash : std::hash<K> {};
+
+template<>
+struct DefaultHash<std::string>
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const
+    {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+template<class K>
+struct DefaultEqual : std::equal_to<K> {};
+
+template<>
+struct DefaultEqual<std::string> : std::equal_to<> {};
+
+// 缓存存储策略: 决定LocalCache/ExpireCache/LRUCache内部使用的哈希表
+// Allocator为节点分配器, 用detail::make_map构造时传入
+// 基于节点的std::unordered_map, 每个条目一次节点分配, 迭代器稳定
+struct NodeStorage
+{
+    template<class K, class V, class Hash = DefaultHash<K>, class KeyEqual = DefaultEqual<K>, class Allocator = std::allocator<std::pair<const K, V>>>
+    using Map = std::unordered_map<K, V, Hash, KeyEqual, Allocator>;
+};
+
+// 开放寻址的FlatHashMap, 条目内联存储, 适合百万级以上的大缓存; 没有节点分配, 忽略Allocator
+struct FlatStorage
+{
+    template<class K, class V, class Hash = DefaultHash<K>, class KeyEqual = DefaultEqual<K>, class Allocator = std::allocator<std::pair<const K, V>>>
+    using Map = FlatHashMap<K, V, Hash, KeyEqual>;
+};
+
+// 值持有策略: 决定缓存条目保存的值类型(Value)和查询返回的类型(Result)
+// 每个值单独分配并以shared_ptr共享, 查询返回共享指针, 未命中为nullptr
+struct SharedValue
+{
+    template<class V>
+    using Value = std::shared_ptr<V>;
+
+    template<class V>
+    using Result = std::shared_ptr<V>;
+
+    template<class V>
+    static const Value<V> &Unwrap(const Result<V> &result)
+    {
+        return result;
+    }
+};
+
+// 值直接存放在哈希表条目中, 查询返回拷贝, 未命中为std::nullopt
+// 没有额外分配, 热点key的查询也没有原子引用计数, 适合小的可拷贝值
+struct InlineValue
+{
+    template<class V>
+    using Value = V;
+
+    template<class V>
+    using Result = std::optional<V>;
+
+    template<class V>
+    static const Value<V> &Unwrap(const Result<V> &result)
+    {
+        return *result;
+    }
+};
+
+namespace detail
+{
+// 哈希表重建标记, 分块遍历时据此判断元素位置是否已变化
+template<class Map>
+size_t rehash_epoch(const Map &map)
+{
+    return map.bucket_count();
+}
+
+template<class K, class V, class Hash, class KeyEqual>
+size_t rehash_epoch(const FlatHashMap<K, V, Hash, KeyEqual> &map)
+{
+    return map.rehash_count();
+}
+
+template<class Hash, class = void>
+struct is_transparent_hash : std::false_type {};
+
+template<class Hash>
+struct is_transparent_hash<Hash, std::void_t<typename Hash::is_transparent>> : std::true_type {};
+
+template<class Map>
+struct heterogeneous_lookup : std::false_type {};
+
+// C++20之前std::unordered_map没有异构find, 只能退化为构造临时key
+#if defined(__cpp_lib_generic_unordered_lookup)
+template<class K, class V, class Hash, class KeyEqual, class Alloc>
+struct heterogeneous_lookup<std::unordered_map<K, V, Hash, KeyEqual, Alloc>> : is_transparent<Hash, KeyEqual> {};
+#endif
+
+template<class K, class V, class Hash, class KeyEqual>
+struct heterogeneous_lookup<FlatHashMap<K, V, Hash, KeyEqual>> : is_transparent<Hash, KeyEqual> {};
+
+// 按任意可比较的key查找, 存储支持时不会构造临时key
+template<class Map, class Q>
+auto find_key(Map &map, const Q &key) -> decltype(map.find(std::declval<const typename Map::key_type &>()))
+{
+    using Key = typename Map::key_type;
+    if constexpr (std::is_same<Q, Key>::value || heterogeneous_lookup<typename std::remove_const<Map>::type>::value)
+    {
+        return map.find(key);
+    }
+    else
+    {
+        return map.find(Key(key));
+    }
+}
+
+// 预取key所在槽位, 仅开放寻址存储有效; 不支持异构查找时跳过, 避免构造临时key
+template<class Map, class Q>
+void prefetch_key(const Map &, const Q &)
+{
+}
+
+template<class K, class V, class Hash, class KeyEqual, class Q>
+void prefetch_key(const FlatHashMap<K, V, Hash, KeyEqual> &map, const Q &key)
+{
+    if constexpr (std::is_same<Q, K>::value || is_transparent<Hash, KeyEqual>::value)
+    {
+        map.prefetch(key);
+    }
+}
+
+// 计算分片路由哈希, 与find_key保持一致: 透明哈希直接计算, 否则先转换为key
+template<class K, class Hash, class Q>
+size_t hash_key(const Hash &hash, const Q &key)
+{
+    if constexpr (std::is_same<Q, K>::value || is_transparent_hash<Hash>::value)
+    {
+        return hash(key);
+    }
+    else
+    {
+        return hash(K(key));
+    }
+}
+
+//构造使用指定节点分配器的哈希表, 不接受分配器的实现(FlatHashMap)直接默认构造
+template<class Map, class Allocator>
+Map make_map(const Allocator &allocator)
+{
+    if constexpr (std::is_constructible<Map, size_t, const typename Map::hasher &, const typename Map::key_equal &, const Allocator &>::value)
+    {
+        return Map(0, typename Map::hasher(), typename Map::key_equal(), allocator);
+    }
+    else
+    {
+        return Map();
+    }
+}
+
+//哈希值映射到分片下标, mask为分片数减一; std::hash对整数是恒等映射, 先做一次混淆再取低位
+inline size_t shard_index(uint64_t hash, size_t mask)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return static_cast<size_t>(hash) & mask;
+}
+}
+}
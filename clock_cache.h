@@ -0,0 +1,203 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <shared_mutex>
+#include "cache_storage.h"
+#include "cache_stats.h"
+
+namespace cache
+{
+// CLOCK 近似 LRU 缓存, 接口与 LRUCache 一致
+// 条目放在固定容量的槽数组里, 命中只在共享锁下置位原子访问标记, 不改动任何链接;
+// 写入新 key 且已满时才转动指针: 跳过并清除有标记的槽, 淘汰第一个没有标记的槽
+// 适合读远多于写的场景, 命中不再需要独占锁
+template <typename Key,
+          typename Value,
+          typename Hash = DefaultHash<Key>,
+          typename KeyEqual = DefaultEqual<Key>,
+          typename Storage = NodeStorage>
+class ClockCache {
+public:
+    using Deleter = std::function<void(const Key &key, Value value)>;
+
+    explicit ClockCache(
+        size_t capacity,
+        Deleter deleter = nullptr
+    ) : capacity_(capacity), deleter_(deleter), hand_(0) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Capacity must be greater than 0");
+        }
+        slots_.reset(new Slot[capacity]);
+        free_.reserve(capacity);
+        for (size_t i = capacity; i > 0; --i) {
+            free_.push_back(i - 1);
+        }
+    }
+
+    ~ClockCache() {
+        clear();
+    }
+
+    // 添加或更新元素
+    void put(const Key& key, Value value) {
+        auto lock = stats_.WriteLock(mutex_);
+        stats_.Put();
+
+        auto it = cache_map_.find(key);
+        if (it != cache_map_.end()) {
+            auto& slot = slots_[it->second];
+            slot.value = std::move(value);
+            slot.mark();
+            return;
+        }
+
+        size_t index;
+        if (!free_.empty()) {
+            index = free_.back();
+            free_.pop_back();
+        } else {
+            index = evict();
+        }
+        // 新条目不带访问标记, 指针转一圈前没有再被访问就会被淘汰
+        auto& slot = slots_[index];
+        slot.key = key;
+        slot.value = std::move(value);
+        slot.used = true;
+        slot.referenced.store(false, std::memory_order_relaxed);
+        cache_map_.emplace(key, index);
+    }
+
+    // 获取元素（可选是否标记为使用）, 只持有共享锁
+    template <typename Q = Key>
+    Value get(const Q& key, bool mark_used = true) {
+        auto lock = stats_.ReadLock(mutex_);
+
+        auto it = detail::find_key(cache_map_, key);
+        if (it == cache_map_.end()) {
+            stats_.Miss();
+            return nullptr; // 或根据 Value 类型返回默认值
+        }
+        stats_.Hit();
+
+        auto& slot = slots_[it->second];
+        if (mark_used) {
+            slot.mark();
+        }
+        return slot.value;
+    }
+
+    // 检查是否存在元素
+    template <typename Q = Key>
+    bool contains(const Q& key) {
+        auto lock = stats_.ReadLock(mutex_);
+        return detail::find_key(cache_map_, key) != cache_map_.end();
+    }
+
+    // 显式移除元素
+    template <typename Q = Key>
+    bool remove(const Q& key) {
+        auto lock = stats_.WriteLock(mutex_);
+
+        auto it = detail::find_key(cache_map_, key);
+        if (it == cache_map_.end()) {
+            return false;
+        }
+        auto index = it->second;
+        cache_map_.erase(it);
+        release(index);
+        free_.push_back(index);
+        return true;
+    }
+
+    // 清空整个缓存
+    void clear() {
+        auto lock = stats_.WriteLock(mutex_);
+
+        free_.clear();
+        for (size_t i = capacity_; i > 0; --i) {
+            if (slots_[i - 1].used) {
+                release(i - 1);
+            }
+            free_.push_back(i - 1);
+        }
+        cache_map_.clear();
+        hand_ = 0;
+    }
+
+    // 获取当前大小
+    size_t size() const {
+        auto lock = stats_.ReadLock(mutex_);
+        return cache_map_.size();
+    }
+
+    // 获取容量
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    // 开启/关闭统计, 默认关闭
+    void enable_stats(bool enabled = true) {
+        stats_.Enable(enabled);
+    }
+
+    CacheStats stats() const {
+        return stats_.Snapshot();
+    }
+
+private:
+    struct Slot {
+        Key key;
+        Value value;
+        bool used = false;
+        std::atomic<bool> referenced{false};
+
+        // 已置位时不再写, 热点 key 的命中只读缓存行
+        void mark() {
+            if (!referenced.load(std::memory_order_relaxed)) {
+                referenced.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // 已满时转动指针找到淘汰槽, 每个有标记的槽最多跳过一次, 最多转一圈
+    size_t evict() {
+        while (true) {
+            auto& slot = slots_[hand_];
+            auto index = hand_;
+            hand_ = hand_ + 1 < capacity_ ? hand_ + 1 : 0;
+            if (slot.referenced.load(std::memory_order_relaxed)) {
+                slot.referenced.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            cache_map_.erase(slot.key);
+            release(index);
+            stats_.Evict();
+            return index;
+        }
+    }
+
+    // 回调后释放槽中的值
+    void release(size_t index) {
+        auto& slot = slots_[index];
+        if (deleter_) {
+            deleter_(slot.key, slot.value);
+        }
+        slot.value = Value();
+        slot.used = false;
+    }
+
+    size_t capacity_;
+    std::unique_ptr<Slot[]> slots_;
+    std::vector<size_t> free_; // 空闲槽, 未满时直接使用
+    typename Storage::template Map<Key, size_t, Hash, KeyEqual> cache_map_;
+    Deleter deleter_;
+    size_t hand_;
+    mutable std::shared_mutex mutex_; // 写入独占, 读取共享
+    mutable CacheStatsRecorder stats_;
+};
+}
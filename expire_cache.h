@@ -2,196 +2,979 @@
 
 #include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <shared_mutex>
 #include <unordered_map>
 #include <functional>
 #include <chrono>
 #include <thread>
-#include <queue>
 #include <atomic>
 #include <unordered_set>
+#include <vector>
+#include <list>
+#include <cstdint>
+#include "cache_storage.h"
+#include "single_flight.h"
+#include "cache_stats.h"
+#include "timing_wheel.h"
+#include "expire_scheduler.h"
+#include "batch_delivery.h"
 
 namespace cache
 {
 
 using namespace std::chrono;
 
-template<class K, class V>
+namespace detail
+{
+// 可拷贝的原子过期时间: 滑动过期时Get在读锁下顺延
+class AtomicDeadline
+{
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    AtomicDeadline(TimePoint deadline = TimePoint())
+    :
+    _ticks(deadline.time_since_epoch().count())
+    {
+    }
+
+    AtomicDeadline(const AtomicDeadline &other)
+    :
+    _ticks(other._ticks.load(std::memory_order_relaxed))
+    {
+    }
+
+    AtomicDeadline &operator=(const AtomicDeadline &other)
+    {
+        this->_ticks.store(other._ticks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    TimePoint Load() const
+    {
+        return TimePoint(TimePoint::duration(this->_ticks.load(std::memory_order_relaxed)));
+    }
+
+    void Store(TimePoint deadline)
+    {
+        this->_ticks.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    //只在至少顺延1毫秒时才写, 热点key的连续命中不会反复写同一缓存行
+    void Extend(TimePoint deadline)
+    {
+        auto ticks = deadline.time_since_epoch().count();
+        auto current = this->_ticks.load(std::memory_order_relaxed);
+        if (ticks - current >= std::chrono::duration_cast<TimePoint::duration>(std::chrono::milliseconds(1)).count())
+        {
+            this->_ticks.store(ticks, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<TimePoint::rep> _ticks;
+};
+
+// 可拷贝的访问标记: Get在读锁下置位, 淘汰时在写锁下检查并清除
+class AccessBit
+{
+public:
+    AccessBit()
+    :
+    _accessed(false)
+    {
+    }
+
+    AccessBit(const AccessBit &other)
+    :
+    _accessed(other._accessed.load(std::memory_order_relaxed))
+    {
+    }
+
+    AccessBit &operator=(const AccessBit &other)
+    {
+        this->_accessed.store(other._accessed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    //已置位时不再写, 避免热点key反复写同一缓存行
+    void Mark()
+    {
+        if (!this->_accessed.load(std::memory_order_relaxed))
+        {
+            this->_accessed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    bool Test() const
+    {
+        return this->_accessed.load(std::memory_order_relaxed);
+    }
+
+    void Clear()
+    {
+        this->_accessed.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> _accessed;
+};
+
+// 在途的过期通知: 清理线程把OnDelete交给任务池执行, 缓存析构时等待在途的通知结束
+// 通知回调中析构缓存时不等待当前线程上的这次通知, 由回调线程记下正在执行的通知
+class ExpireNotifications
+{
+public:
+    ExpireNotifications()
+    :
+    _running(0)
+    {
+    }
+
+    void Begin()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_running++;
+    }
+
+    void End()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_running--;
+        this->_condition.notify_all();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        size_t self = Current() == this ? 1 : 0;
+        this->_condition.wait(lock, [&]() { return this->_running <= self; });
+    }
+
+    static const ExpireNotifications *&Current()
+    {
+        static thread_local const ExpireNotifications *current = nullptr;
+        return current;
+    }
+
+private:
+    std::mutex              _mutex;
+    std::condition_variable _condition;
+    size_t                  _running;
+};
+}
+
+// 超出容量时的淘汰策略
+enum class EvictPolicy
+{
+    LeastRecentlyUsed,      //近似LRU: 按写入顺序淘汰, 期间被访问过的条目获得一次重新排队的机会
+    SoonestExpiring,        //优先淘汰最早过期的条目, 没有设置过期时间的条目按LeastRecentlyUsed淘汰
+};
+
+// Holder为值持有策略, 见SharedValue/InlineValue
+template<class K, class V, class Storage = NodeStorage, class Holder = SharedValue>
 class ExpireCache
 {
 public:
-    using OnRange = std::function<bool(const K &key, const std::shared_ptr<V> &value)>;
-    using Caches = std::unordered_map<K, std::pair<std::shared_ptr<V>, std::chrono::time_point<std::chrono::steady_clock>>>;
-    using OnDelete = std::function<void(const K &key, const std::shared_ptr<V> &value, bool is_manual)>;
-    ExpireCache(const OnDelete &on_delete = nullptr, milliseconds timeout = milliseconds::zero()) 
+    using Value = typename Holder::template Value<V>;
+    using Result = typename Holder::template Result<V>;
+    using OnRange = std::function<bool(const K &key, const Value &value)>;
+    using TimerId = typename TimingWheel<K>::TimerId;
+    struct Entry
+    {
+        Value                       value;
+        detail::AtomicDeadline      expiration;
+        std::chrono::milliseconds   ttl;        //0表示永不过期
+        TimerId                     timer;      //时间轮句柄, 删除时据此取消
+        size_t                      cost;       //以下只在设置了容量上限时维护
+        typename std::list<K>::iterator order;
+        detail::AccessBit           accessed;
+    };
+    using Caches = typename Storage::template Map<K, Entry>;
+    using OnDelete = std::function<void(const K &key, const Value &value, bool is_manual)>;
+    using OnBatchExpire = std::function<void(const std::vector<std::pair<K, Value>> &expired)>;
+    using Cost = std::function<size_t(const K &key, const Value &value)>;
+    static const size_t DefaultScanChunk = 256;
+    static const size_t DefaultSliceEntries = 1024;
+    static constexpr int64_t DefaultSliceTime = 500;    //微秒
+    static const size_t DefaultExpireBatch = 256;
+    static constexpr int64_t DefaultExpireLinger = 100;  //毫秒
+    static const size_t DefaultExpirePending = 65536;
+    static constexpr double DefaultRefreshFraction = 0.2;
+    static const size_t DefaultMaxRefreshes = 64;
+    using Loader = std::function<Result(const K &key)>;
+    //timeout为默认过期时间, 0表示不过期; 单个条目可以用Put/Set的ttl参数单独指定
+    //过期清理由scheduler的线程执行, 默认使用进程内共享的ExpireScheduler::Instance()
+    //清理出的过期条目在共享的WorkerPool上调用OnDelete, 慢回调不会推迟其他缓存的清理; 任务池已满时在清理线程上调用
+    //可以在OnDelete中析构缓存, 此时同一批剩余的过期条目仍会回调
+    ExpireCache(const OnDelete &on_delete = nullptr, milliseconds timeout = milliseconds::zero(), ExpireScheduler &scheduler = ExpireScheduler::Instance()) 
     :
-    _started(false),
+    _sliding(false),
     _timeout(timeout),
-    _on_delete(on_delete)
+    _on_delete(on_delete),
+    _notifications(std::make_shared<detail::ExpireNotifications>()),
+    _scheduler(&scheduler),
+    _task(0),
+    _slice_entries(DefaultSliceEntries),
+    _slice_time(DefaultSliceTime),
+    _next_wakeup(std::chrono::steady_clock::time_point::max()),
+    _bounded(false),
+    _max_entries(SIZE_MAX),
+    _max_bytes(SIZE_MAX),
+    _bytes(0),
+    _policy(EvictPolicy::LeastRecentlyUsed),
+    _refresh_fraction(0),
+    _max_refreshes(DefaultMaxRefreshes)
     {
-        start();
     }
 
     ~ExpireCache()
     {
-        stop();
+        //先等待异步加载结束, 避免注销后又有条目注册清理任务
+        this->_loads.Wait();
+        if (this->_task != 0)
+        {
+            this->_scheduler->Unregister(this->_task);
+        }
+        this->_notifications->Wait();
     }
 
+    //包含已过期但尚未被清理的条目
     size_t Count()
     {
-        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
         return this->_cache.size();
     }
 
-    bool Exists(const K &key)
+    template<class Q = K>
+    bool Exists(const Q &key)
     {
-        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
-        auto itr = this->_cache.find(key);
-        if (itr == this->_cache.end())
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
+        auto itr = detail::find_key(this->_cache, key);
+        if (itr == this->_cache.end() || this->expired(itr->second))
         {
             return false;
         }
         return true;
     }
 
-    std::shared_ptr<V> Get(const K &key)
+    template<class Q = K>
+    Result Get(const Q &key)
     {
-        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
-        auto itr = this->_cache.find(key);
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
+        auto itr = detail::find_key(this->_cache, key);
         if (itr == this->_cache.end())
         {
-            return nullptr;
+            this->_stats.Miss();
+            return Result();
+        }
+        auto &entry = itr->second;
+        bool refresh = false;
+        if (entry.ttl > milliseconds::zero())
+        {
+            //已过期但还没被清理的条目按未命中处理, 清理线程稍后删除
+            auto now = std::chrono::steady_clock::now();
+            auto expiration = entry.expiration.Load();
+            if (expiration <= now)
+            {
+                this->_stats.Miss();
+                return Result();
+            }
+            refresh = this->_refresh_loader && expiration - now <= std::chrono::duration_cast<std::chrono::steady_clock::duration>(entry.ttl * this->_refresh_fraction);
+            //滑动过期只顺延记录的过期时间, 定时器到期时再按新时间重新放置
+            if (this->_sliding.load(std::memory_order_relaxed))
+            {
+                entry.expiration.Extend(now + entry.ttl);
+            }
+        }
+        if (this->_bounded)
+        {
+            entry.accessed.Mark();
         }
-        return itr->second.first;
+        this->_stats.Hit();
+        if (!refresh)
+        {
+            return entry.value;
+        }
+        //释放读锁后再发起刷新, 本次仍返回旧值
+        Result value(entry.value);
+        K refresh_key(itr->first);
+        auto ttl = entry.ttl;
+        read_lock.unlock();
+        this->refresh(refresh_key, ttl);
+        return value;
     }
 
-    std::shared_ptr<V> Delete(const K &key)
+    //删除已过期但尚未清理的条目时按过期处理: 返回空, OnDelete的is_manual为false
+    template<class Q = K>
+    Result Delete(const Q &key)
     {
-        std::unique_lock<std::shared_mutex> write_lock(this->_mutex);
-        auto itr = this->_cache.find(key);
+        auto write_lock = this->_stats.WriteLock(this->_mutex);
+        auto itr = detail::find_key(this->_cache, key);
         if (itr != this->_cache.end())
         {
-            auto value = itr->second.first;
-            this->_cache.erase(itr);
+            auto is_expired = this->expired(itr->second);
+            auto value = std::move(itr->second.value);
+            K erased_key(itr->first);
+            if (itr->second.timer != TimingWheel<K>::InvalidTimer)
+            {
+                this->_timers.Cancel(itr->second.timer);
+            }
+            this->erase(itr);
+            if (is_expired)
+            {
+                this->_stats.Expire();
+            }
             write_lock.unlock();
+            if (is_expired)
+            {
+                if (this->listen_expired())
+                {
+                    std::vector<std::pair<K, Value>> expired;
+                    expired.emplace_back(std::move(erased_key), std::move(value));
+                    this->notify_expired(expired);
+                }
+                return Result();
+            }
             if (this->_on_delete)
             {
-                this->_on_delete(key, value, true);
+                this->_on_delete(erased_key, value, true);
+            }
+            return Result(std::move(value));
+        }
+        return Result();
+    }
+
+    //key不存在(或已过期)时写入, 已存在时保持原值和过期时间不变, 返回缓存中的值以及key是否已存在
+    std::pair<Result, bool> Put(const K &key, const Value &value)
+    {
+        return this->Put(key, value, this->_timeout);
+    }
+
+    std::pair<Result, bool> Put(const K &key, const Value &value, milliseconds ttl)
+    {
+        std::vector<std::pair<K, Value>> expired;
+        std::pair<Result, bool> result;
+        {
+            auto write_lock = this->_stats.WriteLock(this->_mutex);
+            auto itr = this->find_live(key, expired);
+            if (itr == this->_cache.end())
+            {
+                itr = this->add(key, value, ttl);
+                result = {itr->second.value, false};
+                this->evict(expired);
+            }
+            else
+            {
+                result = {itr->second.value, true};
+                if (this->_bounded)
+                {
+                    itr->second.accessed.Mark();
+                }
+            }
+            this->_stats.Put();
+        }
+        this->notify_expired(expired);
+        return result;
+    }
+
+    //写入或覆盖, 覆盖时同时刷新过期时间, 返回被覆盖的旧值
+    Result Set(const K &key, const Value &value)
+    {
+        return this->Set(key, value, this->_timeout);
+    }
+
+    Result Set(const K &key, const Value &value, milliseconds ttl)
+    {
+        std::vector<std::pair<K, Value>> expired;
+        Result previous;
+        {
+            auto write_lock = this->_stats.WriteLock(this->_mutex);
+            this->_stats.Put();
+            auto itr = this->find_live(key, expired);
+            if (itr == this->_cache.end())
+            {
+                this->add(key, value, ttl);
             }
+            else
+            {
+                previous = this->update(itr, value, ttl);
+            }
+            this->evict(expired);
+        }
+        this->notify_expired(expired);
+        return previous;
+    }
+
+    //未命中时调用loader加载并写入, 同一key的并发未命中只执行一次loader
+    //loader返回空时不写入缓存, 抛出的异常会传递给所有等待者
+    Result GetOrLoad(const K &key, const Loader &loader)
+    {
+        auto value = this->Get(key);
+        if (value)
+        {
             return value;
         }
-        return nullptr;
+        return this->_loads.Do(key, this->load(key, loader)).get();
     }
 
-    std::pair<std::shared_ptr<V>, bool> Put(const K &key, const std::shared_ptr<V> &value)
+    //异步版本: 未命中时在共享的WorkerPool上加载, 立即返回future, 适合事件循环中调用
+    //WorkerPool队列已满时不会在调用线程加载, future携带std::runtime_error
+    std::shared_future<Result> GetOrLoadAsync(const K &key, const Loader &loader)
     {
-        std::unique_lock<std::shared_mutex> write_lock(this->_mutex);
-        auto expiration = std::chrono::steady_clock::now() + this->_timeout;
-        auto itr = this->_cache.insert({key, {value, expiration}});
-        if (itr.second && this->_timeout > milliseconds::zero())
+        auto value = this->Get(key);
+        if (value)
         {
-            this->_expiration_queue.push({expiration, key});
+            std::promise<Result> ready;
+            ready.set_value(value);
+            return ready.get_future().share();
         }
-        return {itr.first->second.first, !itr.second};
+        return this->_loads.DoAsync(key, this->load(key, loader));
     }
 
     void Range(const OnRange &on_range) 
     {
         Caches snapshot;
         {
-            std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
+            auto read_lock = this->_stats.ReadLock(this->_mutex);
             snapshot = this->_cache;
         }
 
-        for (auto itr : snapshot)
+        auto now = std::chrono::steady_clock::now();
+        for (auto &itr : snapshot)
         {
-            if (!on_range(itr.first, itr.second.first))
+            if (this->expired(itr.second, now))
+            {
+                continue;
+            }
+            if (!on_range(itr.first, itr.second.value))
             {
                 break;
             }
         }
     }
 
+    //分块遍历: 每次只在读锁内拷贝chunk_size个左右的条目, 回调返回false立即停止
+    //遍历期间发生rehash时不再分块, 在下一次读锁内拷贝全部条目后回调完即结束, 持续增长的缓存不会让遍历反复重来
+    //全程存在的条目不会遗漏; rehash之前已回调过的条目会再回调一次, 回调方需要能容忍重复
+    void Scan(const OnRange &on_range, size_t chunk_size = DefaultScanChunk)
+    {
+        std::vector<std::pair<K, Value>> chunk;
+        chunk.reserve(chunk_size);
+        size_t bucket = 0;
+        size_t bucket_count = 0;
+        size_t epoch = static_cast<size_t>(-1);
+        bool snapshot = false;
+        while (true)
+        {
+            chunk.clear();
+            {
+                auto read_lock = this->_stats.ReadLock(this->_mutex);
+                if (detail::rehash_epoch(this->_cache) != epoch)
+                {
+                    snapshot = epoch != static_cast<size_t>(-1);
+                    epoch = detail::rehash_epoch(this->_cache);
+                    bucket = 0;
+                }
+                bucket_count = this->_cache.bucket_count();
+                auto now = std::chrono::steady_clock::now();
+                while (bucket < bucket_count && (snapshot || chunk.size() < chunk_size))
+                {
+                    for (auto itr = this->_cache.begin(bucket); itr != this->_cache.end(bucket); ++itr)
+                    {
+                        if (this->expired(itr->second, now))
+                        {
+                            continue;
+                        }
+                        chunk.emplace_back(itr->first, itr->second.value);
+                    }
+                    ++bucket;
+                }
+            }
+            for (auto &item : chunk)
+            {
+                if (!on_range(item.first, item.second))
+                {
+                    return;
+                }
+            }
+            if (bucket >= bucket_count)
+            {
+                return;
+            }
+        }
+    }
+
+    //OnDelete在释放写锁后回调
     void Clear()
     {
-        std::unique_lock<std::shared_mutex> write_lock(this->_mutex);
-        if (this->_on_delete)
+        Caches cleared;
         {
-            for (auto& item : this->_cache)
+            auto write_lock = this->_stats.WriteLock(this->_mutex);
+            if (this->_on_delete)
+            {
+                cleared.swap(this->_cache);
+            }
+            else
             {
-                this->_on_delete(item.first, item.second.first, true);
+                this->_cache.clear();
             }
+            this->_timers.Clear();
+            this->_order.clear();
+            this->_bytes = 0;
+        }
+        for (auto &item : cleared)
+        {
+            this->_on_delete(item.first, item.second.value, true);
         }
-        this->_cache.clear();
     }
 
-private:
-    struct ExpirationEntry
+    //开启/关闭统计, 默认关闭
+    void EnableStats(bool enabled = true)
     {
-        std::chrono::time_point<std::chrono::steady_clock> expiration;
-        K key;
+        this->_stats.Enable(enabled);
+    }
+
+    //每次持有写锁清理的上限: 最多max_entries个条目或max_time时间, 没清理完的释放锁后立即继续
+    void SetCleanupSlice(size_t max_entries, std::chrono::microseconds max_time)
+    {
+        auto write_lock = this->_stats.WriteLock(this->_mutex);
+        this->_slice_entries = max_entries > 0 ? max_entries : 1;
+        this->_slice_time = max_time;
+    }
 
-        bool operator>(const ExpirationEntry& other) const
+    //容量上限: 条目数超过max_entries或总开销超过max_bytes时按policy淘汰, 被淘汰的条目与过期条目一样通知(is_manual为false)
+    //cost为空时每个条目的开销按sizeof(K) + sizeof(V)计算; 计数包含已过期但尚未清理的条目
+    void SetCapacity(size_t max_entries, size_t max_bytes = SIZE_MAX, const Cost &cost = nullptr,
+                     EvictPolicy policy = EvictPolicy::LeastRecentlyUsed)
+    {
+        std::vector<std::pair<K, Value>> evicted;
         {
-            return expiration > other.expiration;
+            auto write_lock = this->_stats.WriteLock(this->_mutex);
+            this->_max_entries = max_entries;
+            this->_max_bytes = max_bytes;
+            this->_cost = cost;
+            this->_policy = policy;
+            //重新建立淘汰顺序和开销记录
+            this->_order.clear();
+            this->_bytes = 0;
+            this->_bounded = max_entries != SIZE_MAX || max_bytes != SIZE_MAX;
+            if (this->_bounded)
+            {
+                for (auto itr = this->_cache.begin(); itr != this->_cache.end(); ++itr)
+                {
+                    this->track(itr);
+                }
+                this->evict(evicted);
+            }
         }
-    };
+        this->notify_expired(evicted);
+    }
+
+    //过期通知改为批量异步投递: 攒满batch_size条或最早一条等待超过linger后, 由workers个投递线程调用on_batch_expire
+    //开启后过期条目不再调用OnDelete, 手动删除仍然同步调用OnDelete; 需在写入数据之前调用
+    //待投递的条目最多max_pending条, on_batch_expire跟不上时丢弃之后的过期通知, 见DroppedExpirations
+    void EnableBatchExpire(const OnBatchExpire &on_batch_expire, size_t batch_size = DefaultExpireBatch,
+                           milliseconds linger = milliseconds(DefaultExpireLinger), size_t workers = 1,
+                           size_t max_pending = DefaultExpirePending)
+    {
+        this->_expire_delivery.reset(new BatchDelivery<std::pair<K, Value>>(on_batch_expire, batch_size, linger, workers, max_pending));
+    }
+
+    //批量投递缓冲区已满而丢弃的过期通知条数
+    size_t DroppedExpirations()
+    {
+        return this->_expire_delivery ? this->_expire_delivery->Dropped() : 0;
+    }
+
+    //提前刷新: Get命中时剩余有效期不超过ttl * fraction, 则在后台调用loader重新加载, 加载完成前仍返回旧值
+    //同一key同时只有一个刷新, 与GetOrLoad的加载合并; loader返回空或抛出异常时保留旧值; 需在读取数据之前调用
+    //刷新在共享的WorkerPool上执行, 在途的异步加载达到max_refreshes或任务池已满时跳过本次刷新, 由之后的Get再次触发
+    void EnableRefreshAhead(const Loader &loader, double fraction = DefaultRefreshFraction, size_t max_refreshes = DefaultMaxRefreshes)
+    {
+        this->_refresh_loader = loader;
+        this->_refresh_fraction = fraction;
+        this->_max_refreshes = max_refreshes > 0 ? max_refreshes : 1;
+    }
+
+    //开启滑动过期: 每次Get命中把过期时间顺延为当前时间加上该条目的ttl
+    void EnableSliding(bool enabled = true)
+    {
+        this->_sliding.store(enabled, std::memory_order_relaxed);
+    }
+
+    CacheStats Stats() const
+    {
+        return this->_stats.Snapshot();
+    }
+
+private:
+    //分批推进时间轮, 每批之间检查一次时间上限
+    static const size_t CleanupBatch = 64;
+
+    using Loads = SingleFlight<K, V, DefaultHash<K>, DefaultEqual<K>, Holder>;
 
-    void start()
+    //不计统计的查找, 也不触发滑动顺延和提前刷新
+    Result peek(const K &key)
     {
-        if (this->_started.exchange(true)) return;
-        if (this->_timeout > milliseconds::zero())
+        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
+        auto itr = this->_cache.find(key);
+        if (itr == this->_cache.end() || this->expired(itr->second))
         {
-            this->_cleanup_thread = std::thread(&ExpireCache<K, V>::cleanup, this);
+            return Result();
         }
+        return itr->second.value;
+    }
+
+    typename Loads::Load load(const K &key, const Loader &loader)
+    {
+        return [this, key, loader]() -> Result
+        {
+            //上一轮加载可能刚好完成, 再查一次避免重复加载; 调用方已经记过一次未命中, 这里不计统计
+            auto value = this->peek(key);
+            if (value)
+            {
+                return value;
+            }
+            value = loader(key);
+            if (!value)
+            {
+                return Result();
+            }
+            return this->Put(key, Holder::Unwrap(value)).first;
+        };
+    }
+
+    //只替换仍在缓存中的条目: 刷新期间被删除或已过期的key不会被重新写入
+    //不在读线程上执行loader, 超出上限时放弃
+    void refresh(const K &key, milliseconds ttl)
+    {
+        auto loader = this->_refresh_loader;
+        this->_loads.TryDoAsync(key, [this, key, ttl, loader]() -> Result
+        {
+            auto value = loader(key);
+            if (!value)
+            {
+                return Result();
+            }
+            std::vector<std::pair<K, Value>> expired;
+            {
+                auto write_lock = this->_stats.WriteLock(this->_mutex);
+                auto itr = this->find_live(key, expired);
+                if (itr != this->_cache.end())
+                {
+                    this->update(itr, Holder::Unwrap(value), ttl);
+                    this->evict(expired);
+                }
+            }
+            this->notify_expired(expired);
+            return value;
+        }, this->_max_refreshes);
     }
 
-    void stop()
+    //调用方需持有写锁; 第一次有条目需要过期时才注册清理任务, 之后只在出现更早的过期时间时唤醒调度器
+    void schedule(const K &key, Entry &entry)
     {
-        this->_started = true;
-        if (this->_cleanup_thread.joinable())
+        auto expiration = entry.expiration.Load();
+        entry.timer = this->_timers.Schedule(key, expiration);
+        if (expiration >= this->_next_wakeup)
+        {
+            return;
+        }
+        this->_next_wakeup = expiration;
+        if (this->_task == 0)
+        {
+            this->_task = this->_scheduler->Register([this](std::chrono::steady_clock::time_point now)
+            {
+                return this->cleanup(now);
+            }, expiration);
+        }
+        else
         {
-            this->_cleanup_thread.join();
+            this->_scheduler->Wakeup(this->_task, expiration);
         }
     }
 
-    void cleanup()
+    //由调度线程调用, 返回下一次需要清理的时间
+    //每次分批推进时间轮, 超过条目数或时间上限就释放写锁, 返回now让调度器马上再次执行
+    std::chrono::steady_clock::time_point cleanup(std::chrono::steady_clock::time_point now)
     {
-        std::vector<std::pair<K, std::shared_ptr<V>>> callbacks;
-        while (this->_started)
+        std::vector<std::pair<K, Value>> expired;
+        std::chrono::steady_clock::time_point next;
         {
+            auto write_lock = this->_stats.WriteLock(this->_mutex);
+            auto start = std::chrono::steady_clock::now();
+            size_t processed = 0;
+            bool done = false;
+            do
             {
-                std::unique_lock<std::shared_mutex> write_lock(this->_mutex);
-                while (!this->_expiration_queue.empty() && this->_expiration_queue.top().expiration <= std::chrono::steady_clock::now())
+                auto batch = this->_slice_entries - processed < CleanupBatch ? this->_slice_entries - processed : CleanupBatch;
+                //删除时已取消定时器, 触发的key一定仍在缓存中; 过期时间被顺延的条目返回新时间重新放置
+                auto count = this->_timers.Advance(now, [&](const K &key)
                 {
-                    auto top = this->_expiration_queue.top();
-                    this->_expiration_queue.pop();
-                    auto itr = this->_cache.find(top.key);
-                    if (itr != this->_cache.end() && itr->second.second == top.expiration)
+                    auto itr = this->_cache.find(key);
+                    if (itr == this->_cache.end())
                     {
-                        if (this->_on_delete)
-                        {
-                            callbacks.emplace_back(itr->first, itr->second.first);
-                        }
-                        this->_cache.erase(itr);
+                        return std::chrono::steady_clock::time_point::min();
+                    }
+                    auto expiration = itr->second.expiration.Load();
+                    if (expiration > now)
+                    {
+                        return expiration;
                     }
+                    if (this->listen_expired())
+                    {
+                        expired.emplace_back(itr->first, std::move(itr->second.value));
+                    }
+                    this->erase(itr);
+                    this->_stats.Expire();
+                    return expiration;
+                }, batch);
+                processed += count;
+                done = count < batch;
+            }
+            while (!done && processed < this->_slice_entries && std::chrono::steady_clock::now() - start < this->_slice_time);
+            next = done ? this->_timers.NextExpiration() : now;
+            this->_next_wakeup = next;
+        }
+        if (this->_expire_delivery)
+        {
+            this->_expire_delivery->Push(expired);
+        }
+        else if (!expired.empty())
+        {
+            this->deliver_expired(expired);
+        }
+        return next;
+    }
+
+    //清理线程上调用: 回调持有OnDelete和通知计数的拷贝, 回调中析构缓存后不再访问this
+    void deliver_expired(std::vector<std::pair<K, Value>> &expired)
+    {
+        auto items = std::make_shared<std::vector<std::pair<K, Value>>>(std::move(expired));
+        auto notifications = this->_notifications;
+        auto task = [on_delete = this->_on_delete, notifications, items]()
+        {
+            auto &current = detail::ExpireNotifications::Current();
+            auto previous = current;
+            current = notifications.get();
+            for (auto &item : *items)
+            {
+                on_delete(item.first, item.second, false);
+            }
+            current = previous;
+            notifications->End();
+        };
+        notifications->Begin();
+        if (!WorkerPool::Instance().Submit(task))
+        {
+            task();
+        }
+    }
+
+    static bool expired(const Entry &entry, std::chrono::steady_clock::time_point now)
+    {
+        return entry.ttl > milliseconds::zero() && entry.expiration.Load() <= now;
+    }
+
+    static bool expired(const Entry &entry)
+    {
+        return entry.ttl > milliseconds::zero() && entry.expiration.Load() <= std::chrono::steady_clock::now();
+    }
+
+    //调用方需持有写锁; 查找未过期的条目, 已过期但尚未清理的在这里按过期删除
+    typename Caches::iterator find_live(const K &key, std::vector<std::pair<K, Value>> &expired)
+    {
+        auto itr = this->_cache.find(key);
+        if (itr == this->_cache.end() || !this->expired(itr->second))
+        {
+            return itr;
+        }
+        if (itr->second.timer != TimingWheel<K>::InvalidTimer)
+        {
+            this->_timers.Cancel(itr->second.timer);
+        }
+        if (this->listen_expired())
+        {
+            expired.emplace_back(itr->first, std::move(itr->second.value));
+        }
+        this->erase(itr);
+        this->_stats.Expire();
+        return this->_cache.end();
+    }
+
+    //调用方需持有写锁, key必须不存在
+    typename Caches::iterator add(const K &key, const Value &value, milliseconds ttl)
+    {
+        auto expiration = std::chrono::steady_clock::now() + ttl;
+        auto itr = this->_cache.insert({key, {value, expiration, ttl, TimingWheel<K>::InvalidTimer, 0, this->_order.end(), {}}}).first;
+        if (ttl > milliseconds::zero())
+        {
+            this->schedule(itr->first, itr->second);
+        }
+        if (this->_bounded)
+        {
+            this->track(itr);
+        }
+        return itr;
+    }
+
+    //调用方需持有写锁, 覆盖值并刷新过期时间, 返回旧值
+    Result update(typename Caches::iterator itr, const Value &value, milliseconds ttl)
+    {
+        auto &entry = itr->second;
+        Result previous(std::move(entry.value));
+        entry.value = value;
+        entry.ttl = ttl;
+        if (this->_bounded)
+        {
+            this->_bytes -= entry.cost;
+            entry.cost = this->cost(itr->first, entry.value);
+            this->_bytes += entry.cost;
+            entry.accessed.Mark();
+        }
+        if (ttl <= milliseconds::zero())
+        {
+            if (entry.timer != TimingWheel<K>::InvalidTimer)
+            {
+                this->_timers.Cancel(entry.timer);
+                entry.timer = TimingWheel<K>::InvalidTimer;
+            }
+            return previous;
+        }
+        //过期时间延后时只更新记录, 由定时器到期时顺延; 提前时才需要重新放置定时器
+        auto expiration = std::chrono::steady_clock::now() + ttl;
+        if (entry.timer != TimingWheel<K>::InvalidTimer && expiration < entry.expiration.Load())
+        {
+            this->_timers.Cancel(entry.timer);
+            entry.timer = TimingWheel<K>::InvalidTimer;
+        }
+        entry.expiration.Store(expiration);
+        if (entry.timer == TimingWheel<K>::InvalidTimer)
+        {
+            this->schedule(itr->first, entry);
+        }
+        return previous;
+    }
+
+    size_t cost(const K &key, const Value &value) const
+    {
+        return this->_cost ? this->_cost(key, value) : sizeof(K) + sizeof(V);
+    }
+
+    //调用方需持有写锁; 新条目排在淘汰顺序末尾
+    void track(typename Caches::iterator itr)
+    {
+        auto &entry = itr->second;
+        entry.cost = this->cost(itr->first, entry.value);
+        entry.order = this->_order.insert(this->_order.end(), itr->first);
+        entry.accessed.Clear();
+        this->_bytes += entry.cost;
+    }
+
+    //调用方需持有写锁; 删除条目并维护容量记录, 定时器由调用方处理
+    void erase(typename Caches::iterator itr)
+    {
+        if (this->_bounded)
+        {
+            this->_order.erase(itr->second.order);
+            this->_bytes -= itr->second.cost;
+        }
+        this->_cache.erase(itr);
+    }
+
+    //调用方需持有写锁; 超出容量时逐个淘汰, 每次淘汰均摊O(1)
+    void evict(std::vector<std::pair<K, Value>> &evicted)
+    {
+        while (this->_bounded && !this->_cache.empty() && (this->_cache.size() > this->_max_entries || this->_bytes > this->_max_bytes))
+        {
+            auto itr = this->victim();
+            if (itr->second.timer != TimingWheel<K>::InvalidTimer)
+            {
+                this->_timers.Cancel(itr->second.timer);
+            }
+            if (this->listen_expired())
+            {
+                evicted.emplace_back(itr->first, std::move(itr->second.value));
+            }
+            this->erase(itr);
+            this->_stats.Evict();
+        }
+    }
+
+    typename Caches::iterator victim()
+    {
+        if (this->_policy == EvictPolicy::SoonestExpiring)
+        {
+            this->_timers.FinishCascade();
+            auto timer = this->_timers.Earliest();
+            if (timer != TimingWheel<K>::InvalidTimer)
+            {
+                auto itr = this->_cache.find(this->_timers.Key(timer));
+                if (itr != this->_cache.end())
+                {
+                    return itr;
                 }
             }
-            for (auto &cb: callbacks)
+        }
+        //二次机会: 上次检查后被访问过的条目清除标记并移到队尾, 每个条目最多跳过一次
+        while (true)
+        {
+            auto itr = this->_cache.find(this->_order.front());
+            if (!itr->second.accessed.Test())
             {
-                this->_on_delete(cb.first, cb.second, false);
+                return itr;
             }
-            callbacks.clear();
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            itr->second.accessed.Clear();
+            this->_order.splice(this->_order.end(), this->_order, this->_order.begin());
+        }
+    }
+
+    bool listen_expired() const
+    {
+        return this->_expire_delivery || this->_on_delete;
+    }
+
+    //不持有锁时在调用线程上回调; 清理线程上的过期条目由deliver_expired交给任务池
+    void notify_expired(std::vector<std::pair<K, Value>> &expired)
+    {
+        if (this->_expire_delivery)
+        {
+            this->_expire_delivery->Push(expired);
+            return;
+        }
+        for (auto &item : expired)
+        {
+            this->_on_delete(item.first, item.second, false);
         }
     }
 
     std::shared_mutex           _mutex;
     Caches                      _cache;
-    std::thread                 _cleanup_thread;
-    std::atomic<bool>           _started;
+    std::atomic<bool>           _sliding;
     std::chrono::milliseconds   _timeout;
     OnDelete                    _on_delete;
-    std::priority_queue<ExpirationEntry, std::vector<ExpirationEntry>, std::greater<ExpirationEntry>> _expiration_queue;
+    std::shared_ptr<detail::ExpireNotifications> _notifications;
+    std::unique_ptr<BatchDelivery<std::pair<K, Value>>> _expire_delivery;
+    TimingWheel<K>              _timers;
+    ExpireScheduler             *_scheduler;
+    ExpireScheduler::TaskId     _task;          //0表示尚未注册
+    size_t                      _slice_entries;
+    std::chrono::microseconds   _slice_time;
+    std::chrono::steady_clock::time_point _next_wakeup;
+    bool                        _bounded;       //是否设置了容量上限
+    size_t                      _max_entries;
+    size_t                      _max_bytes;
+    size_t                      _bytes;
+    Cost                        _cost;
+    EvictPolicy                 _policy;
+    std::list<K>                _order;         //淘汰顺序, 只在设置了容量上限时维护
+    Loader                      _refresh_loader;
+    double                      _refresh_fraction;
+    size_t                      _max_refreshes;
+    CacheStatsRecorder          _stats;
+    //必须最后声明: 析构时最先等待异步加载结束
+    Loads                       _loads;
 };
 }
@@ -0,0 +1,182 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace cache
+{
+// 过期调度服务: 多个ExpireCache共用少量清理线程, 线程按最近的到期时间睡眠, 没有到期任务时不唤醒
+// 每个缓存注册一个清理任务, 任务返回下一次需要执行的时间; 同一任务同一时刻只在一个线程上执行
+// 任务在共享的清理线程上执行, 不应调用耗时的用户回调, 否则会推迟所有缓存的过期清理
+class ExpireScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using TaskId = uint64_t;
+    //执行清理, 返回下一次需要执行的时间, 没有待过期条目时返回time_point::max()
+    using Task = std::function<Clock::time_point(Clock::time_point now)>;
+
+    explicit ExpireScheduler(size_t threads = 1)
+    :
+    _next_id(0),
+    _stopped(false)
+    {
+        if (threads == 0)
+        {
+            threads = 1;
+        }
+        for (size_t i = 0; i < threads; ++i)
+        {
+            this->_threads.emplace_back(&ExpireScheduler::run, this);
+        }
+    }
+
+    ~ExpireScheduler()
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_stopped = true;
+            this->_condition.notify_all();
+        }
+        for (auto &thread : this->_threads)
+        {
+            thread.join();
+        }
+    }
+
+    ExpireScheduler(const ExpireScheduler&) = delete;
+    ExpireScheduler& operator=(const ExpireScheduler&) = delete;
+
+    //进程内默认实例, 单个清理线程; 有意不析构, 保证静态缓存析构时仍可注销
+    static ExpireScheduler &Instance()
+    {
+        static ExpireScheduler *instance = new ExpireScheduler();
+        return *instance;
+    }
+
+    TaskId Register(const Task &task, Clock::time_point due = Clock::time_point::max())
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        auto id = ++this->_next_id;
+        this->_tasks.emplace(id, Entry{task, due, Clock::time_point::max(), false, false, std::thread::id()});
+        this->_condition.notify_all();
+        return id;
+    }
+
+    //注销任务, 任务正在执行时等待其结束; 返回后任务不会再被调用
+    //在任务自身的执行过程中注销(例如回调里析构了缓存)时无法等待, 只做标记, 任务返回后由清理线程删除
+    void Unregister(TaskId id)
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        auto itr = this->_tasks.find(id);
+        if (itr != this->_tasks.end() && itr->second.running && itr->second.thread == std::this_thread::get_id())
+        {
+            itr->second.removed = true;
+            return;
+        }
+        this->_condition.wait(lock, [&]()
+        {
+            auto itr = this->_tasks.find(id);
+            return itr == this->_tasks.end() || !itr->second.running;
+        });
+        this->_tasks.erase(id);
+    }
+
+    //要求任务不晚于due执行; 任务正在执行时记下, 执行结束后与其返回值取较早者
+    void Wakeup(TaskId id, Clock::time_point due)
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        auto itr = this->_tasks.find(id);
+        if (itr == this->_tasks.end())
+        {
+            return;
+        }
+        auto &entry = itr->second;
+        if (entry.removed)
+        {
+            return;
+        }
+        if (entry.running)
+        {
+            entry.pending = due < entry.pending ? due : entry.pending;
+            return;
+        }
+        if (due < entry.due)
+        {
+            entry.due = due;
+            this->_condition.notify_all();
+        }
+    }
+
+private:
+    struct Entry
+    {
+        Task                task;
+        Clock::time_point   due;
+        Clock::time_point   pending;
+        bool                running;
+        bool                removed;    //执行期间已在本线程注销
+        std::thread::id     thread;     //正在执行的线程
+    };
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (!this->_stopped)
+        {
+            //注册的缓存数量不多, 直接线性查找最近到期且未在执行的任务
+            auto next = this->_tasks.end();
+            for (auto itr = this->_tasks.begin(); itr != this->_tasks.end(); ++itr)
+            {
+                if (!itr->second.running && (next == this->_tasks.end() || itr->second.due < next->second.due))
+                {
+                    next = itr;
+                }
+            }
+            if (next == this->_tasks.end() || next->second.due == Clock::time_point::max())
+            {
+                this->_condition.wait(lock);
+                continue;
+            }
+            //等待期间任务可能被注销, 先拷贝到期时间
+            auto due = next->second.due;
+            auto now = Clock::now();
+            if (due > now)
+            {
+                this->_condition.wait_until(lock, due);
+                continue;
+            }
+            //执行期间其他线程的Unregister会等待, 本线程的Unregister只做标记, map节点不会失效
+            auto &entry = next->second;
+            entry.running = true;
+            entry.thread = std::this_thread::get_id();
+            entry.pending = Clock::time_point::max();
+            lock.unlock();
+            due = entry.task(now);
+            lock.lock();
+            entry.running = false;
+            if (entry.removed)
+            {
+                this->_tasks.erase(next);
+            }
+            else
+            {
+                entry.due = due < entry.pending ? due : entry.pending;
+            }
+            this->_condition.notify_all();
+        }
+    }
+
+    std::mutex                  _mutex;
+    std::condition_variable     _condition;
+    std::map<TaskId, Entry>     _tasks;
+    TaskId                      _next_id;
+    bool                        _stopped;
+    std::vector<std::thread>    _threads;
+};
+}
@@ -0,0 +1,660 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <tuple>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace cache
+{
+namespace detail
+{
+// 控制字节: 最高位为1表示空槽/墓碑, 否则低7位保存哈希的H2部分
+using ctrl_t = int8_t;
+const ctrl_t CtrlEmpty = -128;
+const ctrl_t CtrlDeleted = -2;
+const size_t GroupWidth = 16;
+
+// 一组16个控制字节, 有SSE2时一条指令完成整组比较
+struct Group
+{
+#ifdef __SSE2__
+    explicit Group(const ctrl_t *pos)
+    :
+    ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos)))
+    {
+    }
+
+    uint32_t Match(ctrl_t h2) const
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+    }
+
+    uint32_t MatchEmptyOrDeleted() const
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+    }
+
+    __m128i ctrl;
+#else
+    explicit Group(const ctrl_t *pos)
+    {
+        std::memcpy(ctrl, pos, GroupWidth);
+    }
+
+    uint32_t Match(ctrl_t h2) const
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GroupWidth; ++i)
+        {
+            mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+        }
+        return mask;
+    }
+
+    uint32_t MatchEmptyOrDeleted() const
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GroupWidth; ++i)
+        {
+            mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+        }
+        return mask;
+    }
+
+    ctrl_t ctrl[GroupWidth];
+#endif
+
+    uint32_t MatchEmpty() const
+    {
+        return Match(CtrlEmpty);
+    }
+};
+
+// 哈希与比较函数都声明is_transparent时, 支持不构造临时key的异构查找
+template<class Hash, class KeyEqual, class = void>
+struct is_transparent : std::false_type {};
+
+template<class Hash, class KeyEqual>
+struct is_transparent<Hash, KeyEqual, std::void_t<typename Hash::is_transparent, typename KeyEqual::is_transparent>> : std::true_type {};
+
+// std::hash对整数是恒等映射, 开放寻址需要先把高低位充分混合
+inline uint64_t mix_hash(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+}
+
+// Swiss table风格的开放寻址哈希表: 控制字节分组探测, 键值内联存储, 无逐条目堆分配
+// 与std::unordered_map的差异: 插入可能使迭代器失效, erase(iterator)不返回后继
+template<class K,
+         class V,
+         class Hash = std::hash<K>,
+         class KeyEqual = std::equal_to<K>>
+class FlatHashMap
+{
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using size_type = size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using local_iterator = value_type *;
+    using const_local_iterator = const value_type *;
+
+    template<bool Const>
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename FlatHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = typename std::conditional<Const, const value_type &, value_type &>::type;
+        using pointer = typename std::conditional<Const, const value_type *, value_type *>::type;
+
+        Iterator() = default;
+
+        Iterator(const detail::ctrl_t *ctrl, const detail::ctrl_t *last, pointer slot)
+        :
+        _ctrl(ctrl),
+        _last(last),
+        _slot(slot)
+        {
+            this->skip();
+        }
+
+        template<bool C = Const, class = typename std::enable_if<C>::type>
+        Iterator(const Iterator<false> &other)
+        :
+        _ctrl(other._ctrl),
+        _last(other._last),
+        _slot(other._slot)
+        {
+        }
+
+        reference operator*() const
+        {
+            return *this->_slot;
+        }
+
+        pointer operator->() const
+        {
+            return this->_slot;
+        }
+
+        Iterator &operator++()
+        {
+            ++this->_ctrl;
+            ++this->_slot;
+            this->skip();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        friend bool operator==(const Iterator &a, const Iterator &b)
+        {
+            return a._ctrl == b._ctrl;
+        }
+
+        friend bool operator!=(const Iterator &a, const Iterator &b)
+        {
+            return a._ctrl != b._ctrl;
+        }
+
+    private:
+        friend class FlatHashMap;
+        friend class Iterator<!Const>;
+
+        void skip()
+        {
+            while (this->_ctrl != this->_last && *this->_ctrl < 0)
+            {
+                ++this->_ctrl;
+                ++this->_slot;
+            }
+        }
+
+        const detail::ctrl_t   *_ctrl = nullptr;
+        const detail::ctrl_t   *_last = nullptr;
+        pointer                 _slot = nullptr;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashMap() = default;
+
+    FlatHashMap(const FlatHashMap &other)
+    :
+    _hash(other._hash),
+    _equal(other._equal)
+    {
+        this->reserve(other._size);
+        //构造函数抛出时不会调用析构函数, 这里释放已拷贝的元素和内存
+        try
+        {
+            for (auto &item : other)
+            {
+                this->insert_unique(item);
+            }
+        }
+        catch (...)
+        {
+            this->destroy();
+            throw;
+        }
+    }
+
+    FlatHashMap(FlatHashMap &&other) noexcept
+    {
+        this->swap(other);
+    }
+
+    FlatHashMap &operator=(FlatHashMap other) noexcept
+    {
+        this->swap(other);
+        return *this;
+    }
+
+    ~FlatHashMap()
+    {
+        this->destroy();
+    }
+
+    void swap(FlatHashMap &other) noexcept
+    {
+        std::swap(this->_ctrl, other._ctrl);
+        std::swap(this->_slots, other._slots);
+        std::swap(this->_capacity, other._capacity);
+        std::swap(this->_size, other._size);
+        std::swap(this->_growth_left, other._growth_left);
+        std::swap(this->_rehashes, other._rehashes);
+        std::swap(this->_hash, other._hash);
+        std::swap(this->_equal, other._equal);
+    }
+
+    iterator begin()
+    {
+        return iterator(this->_ctrl, this->_ctrl + this->_capacity, this->_slots);
+    }
+
+    iterator end()
+    {
+        return iterator(this->_ctrl + this->_capacity, this->_ctrl + this->_capacity, this->_slots + this->_capacity);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this->_ctrl, this->_ctrl + this->_capacity, this->_slots);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this->_ctrl + this->_capacity, this->_ctrl + this->_capacity, this->_slots + this->_capacity);
+    }
+
+    bool empty() const
+    {
+        return this->_size == 0;
+    }
+
+    size_t size() const
+    {
+        return this->_size;
+    }
+
+    // 桶接口: 每个槽位视为一个最多含一个元素的桶, 供分块遍历使用
+    size_t bucket_count() const
+    {
+        return this->_capacity;
+    }
+
+    local_iterator begin(size_t n)
+    {
+        return this->_slots + n;
+    }
+
+    local_iterator end(size_t n)
+    {
+        return this->_slots + n + (this->_ctrl[n] >= 0 ? 1 : 0);
+    }
+
+    const_local_iterator begin(size_t n) const
+    {
+        return this->_slots + n;
+    }
+
+    const_local_iterator end(size_t n) const
+    {
+        return this->_slots + n + (this->_ctrl[n] >= 0 ? 1 : 0);
+    }
+
+    // 每次重建(扩容或清理墓碑)都会改变元素位置, 分块遍历据此判断是否需要重扫
+    size_t rehash_count() const
+    {
+        return this->_rehashes;
+    }
+
+    iterator find(const K &key)
+    {
+        auto index = this->find_index(key, this->hash_of(key));
+        return index == npos ? this->end() : this->iterator_at(index);
+    }
+
+    const_iterator find(const K &key) const
+    {
+        auto index = this->find_index(key, this->hash_of(key));
+        return index == npos ? this->end() : this->iterator_at(index);
+    }
+
+    size_t count(const K &key) const
+    {
+        return this->find_index(key, this->hash_of(key)) == npos ? 0 : 1;
+    }
+
+    template<class Q, class H = Hash, class E = KeyEqual, class = typename std::enable_if<detail::is_transparent<H, E>::value>::type>
+    iterator find(const Q &key)
+    {
+        auto index = this->find_index(key, this->hash_of(key));
+        return index == npos ? this->end() : this->iterator_at(index);
+    }
+
+    template<class Q, class H = Hash, class E = KeyEqual, class = typename std::enable_if<detail::is_transparent<H, E>::value>::type>
+    const_iterator find(const Q &key) const
+    {
+        auto index = this->find_index(key, this->hash_of(key));
+        return index == npos ? this->end() : this->iterator_at(index);
+    }
+
+    template<class Q, class H = Hash, class E = KeyEqual, class = typename std::enable_if<detail::is_transparent<H, E>::value>::type>
+    size_t count(const Q &key) const
+    {
+        return this->find_index(key, this->hash_of(key)) == npos ? 0 : 1;
+    }
+
+    // 预取key探测起点的控制字节和槽位, 供批量查找与当前查找的访存重叠
+    template<class Q>
+    void prefetch(const Q &key) const
+    {
+        if (this->_capacity == 0)
+        {
+            return;
+        }
+        size_t pos = (this->hash_of(key) >> 7) & (this->_capacity - 1);
+        __builtin_prefetch(this->_ctrl + pos);
+        __builtin_prefetch(this->_slots + pos);
+    }
+
+    template<class KK, class... Args>
+    std::pair<iterator, bool> try_emplace(KK &&key, Args &&...args)
+    {
+        auto hash = this->hash_of(key);
+        auto index = this->find_index(key, hash);
+        if (index != npos)
+        {
+            return {this->iterator_at(index), false};
+        }
+        index = this->prepare_insert(hash);
+        new (this->_slots + index) value_type(std::piecewise_construct,
+                                              std::forward_as_tuple(std::forward<KK>(key)),
+                                              std::forward_as_tuple(std::forward<Args>(args)...));
+        this->commit_insert(index, hash);
+        return {this->iterator_at(index), true};
+    }
+
+    template<class KK, class VV>
+    std::pair<iterator, bool> emplace(KK &&key, VV &&value)
+    {
+        return this->try_emplace(std::forward<KK>(key), std::forward<VV>(value));
+    }
+
+    std::pair<iterator, bool> insert(const value_type &value)
+    {
+        return this->try_emplace(value.first, value.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type &&value)
+    {
+        return this->try_emplace(std::move(value.first), std::move(value.second));
+    }
+
+    V &operator[](const K &key)
+    {
+        return this->try_emplace(key).first->second;
+    }
+
+    void erase(const_iterator itr)
+    {
+        this->erase_at(static_cast<size_t>(itr._ctrl - this->_ctrl));
+    }
+
+    void erase(iterator itr)
+    {
+        this->erase_at(static_cast<size_t>(itr._ctrl - this->_ctrl));
+    }
+
+    size_t erase(const K &key)
+    {
+        auto index = this->find_index(key, this->hash_of(key));
+        if (index == npos)
+        {
+            return 0;
+        }
+        this->erase_at(index);
+        return 1;
+    }
+
+    void clear()
+    {
+        this->destroy_slots();
+        if (this->_capacity)
+        {
+            std::memset(this->_ctrl, detail::CtrlEmpty, this->_capacity + detail::GroupWidth);
+        }
+        this->_size = 0;
+        this->_growth_left = max_load(this->_capacity);
+    }
+
+    void reserve(size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        size_t capacity = detail::GroupWidth;
+        while (max_load(capacity) < count)
+        {
+            capacity <<= 1;
+        }
+        if (capacity > this->_capacity)
+        {
+            this->resize(capacity);
+        }
+    }
+
+private:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    // 最大负载因子7/8
+    static size_t max_load(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    template<class Q>
+    uint64_t hash_of(const Q &key) const
+    {
+        return detail::mix_hash(this->_hash(key));
+    }
+
+    iterator iterator_at(size_t index)
+    {
+        return iterator(this->_ctrl + index, this->_ctrl + this->_capacity, this->_slots + index);
+    }
+
+    const_iterator iterator_at(size_t index) const
+    {
+        return const_iterator(this->_ctrl + index, this->_ctrl + this->_capacity, this->_slots + index);
+    }
+
+    // 尾部镜像前GroupWidth个控制字节, 使任意位置都能整组加载
+    void set_ctrl(size_t index, detail::ctrl_t value)
+    {
+        this->_ctrl[index] = value;
+        if (index < detail::GroupWidth)
+        {
+            this->_ctrl[this->_capacity + index] = value;
+        }
+    }
+
+    template<class Q>
+    size_t find_index(const Q &key, uint64_t hash) const
+    {
+        if (this->_size == 0)
+        {
+            return npos;
+        }
+        size_t mask = this->_capacity - 1;
+        size_t pos = (hash >> 7) & mask;
+        auto h2 = static_cast<detail::ctrl_t>(hash & 0x7F);
+        size_t step = 0;
+        while (true)
+        {
+            detail::Group group(this->_ctrl + pos);
+            for (auto match = group.Match(h2); match; match &= match - 1)
+            {
+                size_t index = (pos + __builtin_ctz(match)) & mask;
+                if (this->_equal(this->_slots[index].first, key))
+                {
+                    return index;
+                }
+            }
+            if (group.MatchEmpty())
+            {
+                return npos;
+            }
+            step += detail::GroupWidth;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    size_t find_first_non_full(uint64_t hash) const
+    {
+        size_t mask = this->_capacity - 1;
+        size_t pos = (hash >> 7) & mask;
+        size_t step = 0;
+        while (true)
+        {
+            detail::Group group(this->_ctrl + pos);
+            auto match = group.MatchEmptyOrDeleted();
+            if (match)
+            {
+                return (pos + __builtin_ctz(match)) & mask;
+            }
+            step += detail::GroupWidth;
+            pos = (pos + step) & mask;
+        }
+    }
+
+    // 返回可写入的槽位, 必要时扩容; 调用方构造元素成功后再调用commit_insert登记
+    // 构造抛出异常时槽位仍为空, 表保持原样
+    size_t prepare_insert(uint64_t hash)
+    {
+        size_t index = this->_capacity ? this->find_first_non_full(hash) : npos;
+        if (index == npos || (this->_growth_left == 0 && this->_ctrl[index] == detail::CtrlEmpty))
+        {
+            //墓碑较多时原地重建即可, 否则容量翻倍
+            if (this->_capacity == 0)
+            {
+                this->resize(detail::GroupWidth);
+            }
+            else if (this->_size * 32 <= this->_capacity * 25)
+            {
+                this->resize(this->_capacity);
+            }
+            else
+            {
+                this->resize(this->_capacity * 2);
+            }
+            index = this->find_first_non_full(hash);
+        }
+        return index;
+    }
+
+    void commit_insert(size_t index, uint64_t hash)
+    {
+        if (this->_ctrl[index] == detail::CtrlEmpty)
+        {
+            --this->_growth_left;
+        }
+        this->set_ctrl(index, static_cast<detail::ctrl_t>(hash & 0x7F));
+        ++this->_size;
+    }
+
+    void insert_unique(const value_type &value)
+    {
+        auto hash = this->hash_of(value.first);
+        auto index = this->prepare_insert(hash);
+        new (this->_slots + index) value_type(value);
+        this->commit_insert(index, hash);
+    }
+
+    void erase_at(size_t index)
+    {
+        this->_slots[index].~value_type();
+        this->set_ctrl(index, detail::CtrlDeleted);
+        --this->_size;
+    }
+
+    void resize(size_t capacity)
+    {
+        //两块内存都分配成功后再替换, 分配失败时表保持原样
+        std::unique_ptr<detail::ctrl_t[]> ctrl(new detail::ctrl_t[capacity + detail::GroupWidth]);
+        auto slots = std::allocator<value_type>().allocate(capacity);
+        std::memset(ctrl.get(), detail::CtrlEmpty, capacity + detail::GroupWidth);
+
+        auto old_ctrl = this->_ctrl;
+        auto old_slots = this->_slots;
+        auto old_capacity = this->_capacity;
+        this->_ctrl = ctrl.release();
+        this->_slots = slots;
+        this->_capacity = capacity;
+        this->_growth_left = max_load(capacity) - this->_size;
+        ++this->_rehashes;
+
+        for (size_t i = 0; i < old_capacity; ++i)
+        {
+            if (old_ctrl[i] < 0)
+            {
+                continue;
+            }
+            auto hash = this->hash_of(old_slots[i].first);
+            auto index = this->find_first_non_full(hash);
+            this->set_ctrl(index, static_cast<detail::ctrl_t>(hash & 0x7F));
+            new (this->_slots + index) value_type(std::move(old_slots[i]));
+            old_slots[i].~value_type();
+        }
+        if (old_capacity)
+        {
+            delete[] old_ctrl;
+            std::allocator<value_type>().deallocate(old_slots, old_capacity);
+        }
+    }
+
+    void destroy_slots()
+    {
+        if (std::is_trivially_destructible<value_type>::value)
+        {
+            return;
+        }
+        for (size_t i = 0; i < this->_capacity; ++i)
+        {
+            if (this->_ctrl[i] >= 0)
+            {
+                this->_slots[i].~value_type();
+            }
+        }
+    }
+
+    void destroy()
+    {
+        if (this->_capacity == 0)
+        {
+            return;
+        }
+        this->destroy_slots();
+        delete[] this->_ctrl;
+        std::allocator<value_type>().deallocate(this->_slots, this->_capacity);
+        this->_ctrl = nullptr;
+        this->_slots = nullptr;
+        this->_capacity = 0;
+        this->_size = 0;
+        this->_growth_left = 0;
+    }
+
+    detail::ctrl_t     *_ctrl = nullptr;
+    value_type         *_slots = nullptr;
+    size_t              _capacity = 0;
+    size_t              _size = 0;
+    size_t              _growth_left = 0;
+    size_t              _rehashes = 0;
+    Hash                _hash;
+    KeyEqual            _equal;
+};
+}
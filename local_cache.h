@@ -5,29 +5,45 @@
 #include <shared_mutex>
 #include <unordered_map>
 #include <functional>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "cache_storage.h"
+#include "single_flight.h"
+#include "cache_stats.h"
 
 namespace cache
 {
 
-template<class K, class V>
+// Holder为值持有策略: SharedValue(默认)按shared_ptr共享, InlineValue内联存储并返回拷贝
+template<class K, class V, class Storage = NodeStorage, class Holder = SharedValue>
 class LocalCache
 {
 public:
-    using OnRange = std::function<bool(const K &key, const std::shared_ptr<V> &value)>;
-    using Caches = std::unordered_map<K, std::shared_ptr<V>>;
+    using Value = typename Holder::template Value<V>;
+    using Result = typename Holder::template Result<V>;
+    using OnRange = std::function<bool(const K &key, const Value &value)>;
+    using Caches = typename Storage::template Map<K, Value>;
+    using Item = std::pair<K, Value>;
+    using Loader = std::function<Result(const K &key)>;
+    static const size_t DefaultScanChunk = 256;
     LocalCache() = default;
     ~LocalCache() = default;
 
     size_t Count()
     {
-        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
         return this->_cache.size();
     }
 
-    bool Exists(const K &key)
+    template<class Q = K>
+    bool Exists(const Q &key)
     {
-        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
-        auto itr = this->_cache.find(key);
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
+        auto itr = detail::find_key(this->_cache, key);
         if (itr == this->_cache.end())
         {
             return false;
@@ -35,45 +51,110 @@ public:
         return true;
     }
 
-    std::shared_ptr<V> Get(const K &key)
+    template<class Q = K>
+    Result Get(const Q &key)
     {
-        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
-        auto itr = this->_cache.find(key);
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
+        auto itr = detail::find_key(this->_cache, key);
         if (itr == this->_cache.end())
         {
-            return nullptr;
+            this->_stats.Miss();
+            return Result();
         }
+        this->_stats.Hit();
         return itr->second;
     }
 
-    std::shared_ptr<V> Delete(const K &key)
+    template<class Q = K>
+    Result Delete(const Q &key)
     {
-        std::unique_lock<std::shared_mutex> write_lock(this->_mutex);
-        auto itr = this->_cache.find(key);
+        auto write_lock = this->_stats.WriteLock(this->_mutex);
+        auto itr = detail::find_key(this->_cache, key);
         if (itr != this->_cache.end())
         {
+            Result value(std::move(itr->second));
             this->_cache.erase(itr);
-            return itr->second;
+            return value;
         }
-        return nullptr;
+        return Result();
     }
 
-    std::pair<std::shared_ptr<V>, bool> Put(const K &key, const std::shared_ptr<V> &value)
+    std::pair<Result, bool> Put(const K &key, const Value &value)
     {
-        std::unique_lock<std::shared_mutex> write_lock(this->_mutex);
+        auto write_lock = this->_stats.WriteLock(this->_mutex);
         auto itr = this->_cache.insert({key, value});
+        this->_stats.Put();
         return {itr.first->second, !itr.second};
     }
 
+    //未命中时调用loader加载并写入, 同一key的并发未命中只执行一次loader
+    //loader返回空时不写入缓存, 抛出的异常会传递给所有等待者
+    Result GetOrLoad(const K &key, const Loader &loader)
+    {
+        auto value = this->Get(key);
+        if (value)
+        {
+            return value;
+        }
+        return this->_loads.Do(key, this->load(key, loader)).get();
+    }
+
+    //异步版本: 未命中时在共享的WorkerPool上加载, 立即返回future, 适合事件循环中调用
+    //WorkerPool队列已满时不会在调用线程加载, future携带std::runtime_error
+    std::shared_future<Result> GetOrLoadAsync(const K &key, const Loader &loader)
+    {
+        auto value = this->Get(key);
+        if (value)
+        {
+            std::promise<Result> ready;
+            ready.set_value(value);
+            return ready.get_future().share();
+        }
+        return this->_loads.DoAsync(key, this->load(key, loader));
+    }
+
+    //批量查找: 只加一次读锁, 结果与keys顺序一致, 未命中为空
+    template<class Q = K>
+    std::vector<Result> MultiGet(const std::vector<Q> &keys)
+    {
+        std::vector<Result> results(keys.size());
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
+        this->multi_get(keys, keys.size(), [](size_t i) { return i; }, results);
+        return results;
+    }
+
+    //按下标批量查找, 只处理keys[indexes[i]]并写入results对应位置, 供分片缓存合并加锁
+    template<class Q>
+    void MultiGet(const std::vector<Q> &keys, const std::vector<size_t> &indexes, std::vector<Result> &results)
+    {
+        auto read_lock = this->_stats.ReadLock(this->_mutex);
+        this->multi_get(keys, indexes.size(), [&](size_t i) { return indexes[i]; }, results);
+    }
+
+    //批量写入: 只加一次写锁, 每项返回值与Put相同
+    std::vector<std::pair<Result, bool>> MultiPut(const std::vector<Item> &items)
+    {
+        std::vector<std::pair<Result, bool>> results(items.size());
+        auto write_lock = this->_stats.WriteLock(this->_mutex);
+        this->multi_put(items, items.size(), [](size_t i) { return i; }, results);
+        return results;
+    }
+
+    void MultiPut(const std::vector<Item> &items, const std::vector<size_t> &indexes, std::vector<std::pair<Result, bool>> &results)
+    {
+        auto write_lock = this->_stats.WriteLock(this->_mutex);
+        this->multi_put(items, indexes.size(), [&](size_t i) { return indexes[i]; }, results);
+    }
+
     void Range(const OnRange &on_range) 
     {
         Caches snapshot;
         {
-            std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
+            auto read_lock = this->_stats.ReadLock(this->_mutex);
             snapshot = this->_cache;
         }
 
-        for (auto itr : snapshot)
+        for (auto &itr : snapshot)
         {
             if (!on_range(itr.first, itr.second))
             {
@@ -82,14 +163,659 @@ public:
         }
     }
 
+    //分块遍历: 每次只在读锁内拷贝chunk_size个左右的条目, 回调返回false立即停止
+    //遍历期间发生rehash时不再分块, 在下一次读锁内拷贝全部条目后回调完即结束, 持续增长的缓存不会让遍历反复重来
+    //全程存在的条目不会遗漏; rehash之前已回调过的条目会再回调一次, 回调方需要能容忍重复
+    void Scan(const OnRange &on_range, size_t chunk_size = DefaultScanChunk)
+    {
+        std::vector<Item> chunk;
+        chunk.reserve(chunk_size);
+        size_t bucket = 0;
+        size_t bucket_count = 0;
+        size_t epoch = static_cast<size_t>(-1);
+        bool snapshot = false;
+        while (true)
+        {
+            chunk.clear();
+            {
+                auto read_lock = this->_stats.ReadLock(this->_mutex);
+                if (detail::rehash_epoch(this->_cache) != epoch)
+                {
+                    snapshot = epoch != static_cast<size_t>(-1);
+                    epoch = detail::rehash_epoch(this->_cache);
+                    bucket = 0;
+                }
+                bucket_count = this->_cache.bucket_count();
+                while (bucket < bucket_count && (snapshot || chunk.size() < chunk_size))
+                {
+                    for (auto itr = this->_cache.begin(bucket); itr != this->_cache.end(bucket); ++itr)
+                    {
+                        chunk.emplace_back(itr->first, itr->second);
+                    }
+                    ++bucket;
+                }
+            }
+            for (auto &item : chunk)
+            {
+                if (!on_range(item.first, item.second))
+                {
+                    return;
+                }
+            }
+            if (bucket >= bucket_count)
+            {
+                return;
+            }
+        }
+    }
+
     void Clear()
     {
-        std::unique_lock<std::shared_mutex> write_lock(this->_mutex);
+        auto write_lock = this->_stats.WriteLock(this->_mutex);
         this->_cache.clear();
     }
 
+    //开启/关闭统计, 默认关闭
+    void EnableStats(bool enabled = true)
+    {
+        this->_stats.Enable(enabled);
+    }
+
+    CacheStats Stats() const
+    {
+        return this->_stats.Snapshot();
+    }
+
 private:
+    //提前预取后面第PrefetchDistance个key所在的槽位, 与当前查找的访存重叠
+    static const size_t PrefetchDistance = 8;
+
+    template<class Q, class IndexOf>
+    void multi_get(const std::vector<Q> &keys, size_t count, const IndexOf &index_of, std::vector<Result> &results)
+    {
+        size_t hits = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i + PrefetchDistance < count)
+            {
+                detail::prefetch_key(this->_cache, keys[index_of(i + PrefetchDistance)]);
+            }
+            auto index = index_of(i);
+            auto itr = detail::find_key(this->_cache, keys[index]);
+            if (itr != this->_cache.end())
+            {
+                results[index] = itr->second;
+                hits++;
+            }
+        }
+        this->_stats.Hit(hits);
+        this->_stats.Miss(count - hits);
+    }
+
+    template<class IndexOf>
+    void multi_put(const std::vector<Item> &items, size_t count, const IndexOf &index_of, std::vector<std::pair<Result, bool>> &results)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto index = index_of(i);
+            auto itr = this->_cache.insert(items[index]);
+            results[index] = {itr.first->second, !itr.second};
+        }
+        this->_stats.Put(count);
+    }
+
+    using Loads = SingleFlight<K, V, DefaultHash<K>, DefaultEqual<K>, Holder>;
+
+    //不计统计的查找
+    Result peek(const K &key)
+    {
+        std::shared_lock<std::shared_mutex> read_lock(this->_mutex);
+        auto itr = this->_cache.find(key);
+        if (itr == this->_cache.end())
+        {
+            return Result();
+        }
+        return itr->second;
+    }
+
+    typename Loads::Load load(const K &key, const Loader &loader)
+    {
+        return [this, key, loader]() -> Result
+        {
+            //上一轮加载可能刚好完成, 再查一次避免重复加载; 调用方已经记过一次未命中, 这里不计统计
+            auto value = this->peek(key);
+            if (value)
+            {
+                return value;
+            }
+            value = loader(key);
+            if (!value)
+            {
+                return Result();
+            }
+            return this->Put(key, Holder::Unwrap(value)).first;
+        };
+    }
+
     std::shared_mutex   _mutex;
     Caches              _cache;
+    CacheStatsRecorder  _stats;
+    //必须最后声明: 析构时最先等待异步加载结束
+    Loads               _loads;
+};
+
+// 分片本地缓存: 按key哈希路由到多个LocalCache, 每个分片独立加锁, 降低写锁竞争
+template<class K, class V, class Storage = NodeStorage, class Holder = SharedValue>
+class ShardedLocalCache
+{
+public:
+    using Value = typename LocalCache<K, V, Storage, Holder>::Value;
+    using Result = typename LocalCache<K, V, Storage, Holder>::Result;
+    using OnRange = typename LocalCache<K, V, Storage, Holder>::OnRange;
+    using Item = typename LocalCache<K, V, Storage, Holder>::Item;
+    using Loader = typename LocalCache<K, V, Storage, Holder>::Loader;
+    static const size_t DefaultShardCount = 16;
+    explicit ShardedLocalCache(size_t shard_count = DefaultShardCount)
+    {
+        if (shard_count == 0)
+        {
+            throw std::invalid_argument("Shard count must be greater than 0");
+        }
+        //分片数向上取整为2的幂, 用掩码代替取模
+        size_t count = 1;
+        while (count < shard_count)
+        {
+            count <<= 1;
+        }
+        this->_mask = count - 1;
+        this->_shards = std::vector<Shard>(count);
+    }
+    ~ShardedLocalCache() = default;
+
+    size_t ShardCount() const
+    {
+        return this->_shards.size();
+    }
+
+    LocalCache<K, V, Storage, Holder> &GetShard(size_t index)
+    {
+        return this->_shards[index].cache;
+    }
+
+    size_t Count()
+    {
+        size_t count = 0;
+        for (auto &shard : this->_shards)
+        {
+            count += shard.cache.Count();
+        }
+        return count;
+    }
+
+    template<class Q = K>
+    bool Exists(const Q &key)
+    {
+        return this->shard(key).Exists(key);
+    }
+
+    template<class Q = K>
+    Result Get(const Q &key)
+    {
+        return this->shard(key).Get(key);
+    }
+
+    template<class Q = K>
+    Result Delete(const Q &key)
+    {
+        return this->shard(key).Delete(key);
+    }
+
+    std::pair<Result, bool> Put(const K &key, const Value &value)
+    {
+        return this->shard(key).Put(key, value);
+    }
+
+    Result GetOrLoad(const K &key, const Loader &loader)
+    {
+        return this->shard(key).GetOrLoad(key, loader);
+    }
+
+    std::shared_future<Result> GetOrLoadAsync(const K &key, const Loader &loader)
+    {
+        return this->shard(key).GetOrLoadAsync(key, loader);
+    }
+
+    //按分片分组后批量查找, 每个涉及的分片只加一次读锁, 结果与keys顺序一致
+    template<class Q = K>
+    std::vector<Result> MultiGet(const std::vector<Q> &keys)
+    {
+        std::vector<Result> results(keys.size());
+        auto groups = this->group(keys.size(), [&](size_t i) -> const Q & { return keys[i]; });
+        for (size_t i = 0; i < groups.size(); ++i)
+        {
+            if (!groups[i].empty())
+            {
+                this->_shards[i].cache.MultiGet(keys, groups[i], results);
+            }
+        }
+        return results;
+    }
+
+    std::vector<std::pair<Result, bool>> MultiPut(const std::vector<Item> &items)
+    {
+        std::vector<std::pair<Result, bool>> results(items.size());
+        auto groups = this->group(items.size(), [&](size_t i) -> const K & { return items[i].first; });
+        for (size_t i = 0; i < groups.size(); ++i)
+        {
+            if (!groups[i].empty())
+            {
+                this->_shards[i].cache.MultiPut(items, groups[i], results);
+            }
+        }
+        return results;
+    }
+
+    void Range(const OnRange &on_range)
+    {
+        //逐个分片拷贝快照, 峰值内存只有一个分片大小
+        bool stopped = false;
+        for (auto &shard : this->_shards)
+        {
+            shard.cache.Range([&](const K &key, const Value &value)
+            {
+                if (!on_range(key, value))
+                {
+                    stopped = true;
+                }
+                return !stopped;
+            });
+            if (stopped)
+            {
+                break;
+            }
+        }
+    }
+
+    //逐分片分块遍历, 任意时刻只持有一个分片的读锁
+    void Scan(const OnRange &on_range, size_t chunk_size = LocalCache<K, V, Storage, Holder>::DefaultScanChunk)
+    {
+        bool stopped = false;
+        for (auto &shard : this->_shards)
+        {
+            shard.cache.Scan([&](const K &key, const Value &value)
+            {
+                if (!on_range(key, value))
+                {
+                    stopped = true;
+                }
+                return !stopped;
+            }, chunk_size);
+            if (stopped)
+            {
+                break;
+            }
+        }
+    }
+
+    void Clear()
+    {
+        for (auto &shard : this->_shards)
+        {
+            shard.cache.Clear();
+        }
+    }
+
+    void EnableStats(bool enabled = true)
+    {
+        for (auto &shard : this->_shards)
+        {
+            shard.cache.EnableStats(enabled);
+        }
+    }
+
+    //汇总所有分片的统计
+    CacheStats Stats() const
+    {
+        CacheStats stats;
+        for (auto &shard : this->_shards)
+        {
+            stats += shard.cache.Stats();
+        }
+        return stats;
+    }
+
+private:
+    //按缓存行对齐, 避免相邻分片的锁伪共享
+    struct alignas(64) Shard
+    {
+        LocalCache<K, V, Storage, Holder> cache;
+    };
+
+    template<class Q>
+    size_t index(const Q &key) const
+    {
+        return detail::shard_index(detail::hash_key<K>(DefaultHash<K>{}, key), this->_mask);
+    }
+
+    template<class Q>
+    LocalCache<K, V, Storage, Holder> &shard(const Q &key)
+    {
+        return this->_shards[this->index(key)].cache;
+    }
+
+    //按分片收集下标, key_of(i)返回第i个key
+    template<class KeyOf>
+    std::vector<std::vector<size_t>> group(size_t count, const KeyOf &key_of) const
+    {
+        std::vector<std::vector<size_t>> groups(this->_shards.size());
+        for (size_t i = 0; i < count; ++i)
+        {
+            groups[this->index(key_of(i))].push_back(i);
+        }
+        return groups;
+    }
+
+    size_t              _mask;
+    std::vector<Shard>  _shards;
+};
+
+namespace detail
+{
+// 读者登记项: 每个线程在每个ReadMostlyLocalCache上各有一项, 独占一条缓存行
+struct alignas(64) EpochReader
+{
+    std::atomic<uint64_t>   epoch{0};           //进入读临界区时看到的代号, 0表示不在临界区
+    std::atomic<bool>       in_use{true};       //线程退出时清除, 登记项可以给新线程复用
+    std::atomic<bool>       orphaned{false};    //缓存析构时置位, 线程侧据此清理
+    size_t                  depth = 0;          //嵌套读取层数, 只有所属线程访问
+};
+
+// 线程本地的登记表, 按缓存实例编号查找本线程的登记项; 编号不复用, 缓存析构后地址被复用也不会误认
+class EpochReaders
+{
+public:
+    ~EpochReaders()
+    {
+        for (auto &entry : this->_entries)
+        {
+            entry.second->in_use.store(false, std::memory_order_release);
+        }
+    }
+
+    template<class Register>
+    EpochReader &Find(uint64_t domain, const Register &register_reader)
+    {
+        for (auto &entry : this->_entries)
+        {
+            if (entry.first == domain)
+            {
+                return *entry.second;
+            }
+        }
+        //登记新缓存前顺带清理已析构缓存的登记项
+        this->_entries.erase(std::remove_if(this->_entries.begin(), this->_entries.end(), [](const Entry &entry)
+        {
+            return entry.second->orphaned.load(std::memory_order_relaxed);
+        }), this->_entries.end());
+        this->_entries.emplace_back(domain, register_reader());
+        return *this->_entries.back().second;
+    }
+
+    static EpochReaders &Local()
+    {
+        static thread_local EpochReaders readers;
+        return readers;
+    }
+
+private:
+    using Entry = std::pair<uint64_t, std::shared_ptr<EpochReader>>;
+
+    std::vector<Entry> _entries;
+};
+
+inline uint64_t next_epoch_domain()
+{
+    static std::atomic<uint64_t> next(0);
+    return ++next;
+}
+}
+
+// 读多写少本地缓存: 写时复制整张表并原子发布(RCU), 读路径不竞争共享锁
+// 读者在本线程独占的登记项上用普通store公布进入时看到的代号, 退出时清零, 没有共享计数器上的原子读改写;
+// 公布代号与读取表指针之间需要一次store-load栅栏, 与写者扫描前的栅栏配对
+// 写者发布新表后递增代号, 扫描所有登记项, 等待仍停留在旧代号上的读者退出后回收旧表
+// 每次写入都会复制整张表, 只适合路由/配置这类很少更新的数据
+template<class K, class V, class Storage = NodeStorage, class Holder = SharedValue>
+class ReadMostlyLocalCache
+{
+public:
+    using Value = typename Holder::template Value<V>;
+    using Result = typename Holder::template Result<V>;
+    using OnRange = std::function<bool(const K &key, const Value &value)>;
+    using Caches = typename Storage::template Map<K, Value>;
+    using Snapshot = std::shared_ptr<const Caches>;
+    ReadMostlyLocalCache()
+    :
+    _domain(detail::next_epoch_domain()),
+    _epoch(1),
+    _current(new Snapshot(std::make_shared<const Caches>()))
+    {
+    }
+
+    ~ReadMostlyLocalCache()
+    {
+        for (auto &reader : this->_readers)
+        {
+            reader->orphaned.store(true, std::memory_order_relaxed);
+        }
+        delete this->_current.load();
+    }
+
+    ReadMostlyLocalCache(const ReadMostlyLocalCache&) = delete;
+    ReadMostlyLocalCache& operator=(const ReadMostlyLocalCache&) = delete;
+
+    size_t Count()
+    {
+        ReadGuard guard(*this);
+        return guard.caches().size();
+    }
+
+    template<class Q = K>
+    bool Exists(const Q &key)
+    {
+        ReadGuard guard(*this);
+        return detail::find_key(guard.caches(), key) != guard.caches().end();
+    }
+
+    template<class Q = K>
+    Result Get(const Q &key)
+    {
+        ReadGuard guard(*this);
+        auto itr = detail::find_key(guard.caches(), key);
+        if (itr == guard.caches().end())
+        {
+            this->_stats.Miss();
+            return Result();
+        }
+        this->_stats.Hit();
+        return itr->second;
+    }
+
+    template<class Q = K>
+    Result Delete(const Q &key)
+    {
+        std::unique_lock<std::mutex> write_lock(this->_write_mutex);
+        auto &current = **this->_current.load();
+        auto itr = detail::find_key(current, key);
+        if (itr == current.end())
+        {
+            return Result();
+        }
+        Result value(itr->second);
+        Caches caches(current);
+        caches.erase(itr->first);
+        this->publish(std::move(caches));
+        return value;
+    }
+
+    std::pair<Result, bool> Put(const K &key, const Value &value)
+    {
+        std::unique_lock<std::mutex> write_lock(this->_write_mutex);
+        auto &current = **this->_current.load();
+        auto itr = current.find(key);
+        if (itr != current.end())
+        {
+            return {itr->second, true};
+        }
+        Caches caches(current);
+        caches.emplace(key, value);
+        this->publish(std::move(caches));
+        this->_stats.Put();
+        return {value, false};
+    }
+
+    //整表替换, 批量更新时只复制/发布一次
+    void Reset(Caches caches)
+    {
+        std::unique_lock<std::mutex> write_lock(this->_write_mutex);
+        this->publish(std::move(caches));
+    }
+
+    //返回当前发布的只读快照, 持有期间不会被回收
+    Snapshot Load()
+    {
+        ReadGuard guard(*this);
+        return *guard.snapshot;
+    }
+
+    void Range(const OnRange &on_range)
+    {
+        //遍历已发布的不可变快照, 无需拷贝整张表
+        auto snapshot = this->Load();
+        for (auto &itr : *snapshot)
+        {
+            if (!on_range(itr.first, itr.second))
+            {
+                break;
+            }
+        }
+    }
+
+    void Clear()
+    {
+        this->Reset(Caches());
+    }
+
+    void EnableStats(bool enabled = true)
+    {
+        this->_stats.Enable(enabled);
+    }
+
+    CacheStats Stats() const
+    {
+        return this->_stats.Snapshot();
+    }
+
+private:
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(ReadMostlyLocalCache &owner)
+        :
+        _reader(owner.reader())
+        {
+            if (this->_reader.depth++ == 0)
+            {
+                this->_reader.epoch.store(owner._epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+                //代号必须先于表指针的读取对写者可见
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+            this->snapshot = owner._current.load(std::memory_order_acquire);
+        }
+
+        ~ReadGuard()
+        {
+            if (--this->_reader.depth == 0)
+            {
+                this->_reader.epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        const Caches &caches() const
+        {
+            return **this->snapshot;
+        }
+
+        Snapshot *snapshot;
+
+    private:
+        detail::EpochReader &_reader;
+    };
+
+    //本线程的登记项, 首次读取时登记
+    detail::EpochReader &reader()
+    {
+        return detail::EpochReaders::Local().Find(this->_domain, [this]()
+        {
+            return this->register_reader();
+        });
+    }
+
+    //优先复用已退出线程留下的登记项
+    std::shared_ptr<detail::EpochReader> register_reader()
+    {
+        std::unique_lock<std::mutex> lock(this->_readers_mutex);
+        for (auto &reader : this->_readers)
+        {
+            if (!reader->in_use.load(std::memory_order_acquire))
+            {
+                reader->in_use.store(true, std::memory_order_relaxed);
+                return reader;
+            }
+        }
+        this->_readers.push_back(std::make_shared<detail::EpochReader>());
+        return this->_readers.back();
+    }
+
+    //调用方需持有_write_mutex
+    void publish(Caches &&caches)
+    {
+        auto next = new Snapshot(std::make_shared<const Caches>(std::move(caches)));
+        auto prev = this->_current.exchange(next);
+        this->synchronize();
+        delete prev;
+    }
+
+    //等待宽限期: 递增代号后, 公布了更早代号的读者可能还持有旧表, 等它们退出或进入新代号
+    void synchronize()
+    {
+        auto target = this->_epoch.fetch_add(1) + 1;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::vector<std::shared_ptr<detail::EpochReader>> readers;
+        {
+            std::unique_lock<std::mutex> lock(this->_readers_mutex);
+            readers = this->_readers;
+        }
+        for (auto &reader : readers)
+        {
+            while (true)
+            {
+                auto epoch = reader->epoch.load(std::memory_order_acquire);
+                if (epoch == 0 || epoch >= target)
+                {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    uint64_t                    _domain;
+    std::atomic<uint64_t>       _epoch;
+    std::atomic<Snapshot*>      _current;
+    std::mutex                  _readers_mutex;
+    std::vector<std::shared_ptr<detail::EpochReader>> _readers;
+    std::mutex                  _write_mutex;
+    CacheStatsRecorder          _stats;
 };
 }
@@ -1,123 +1,222 @@
 #pragma once
 #include <list>
+#include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
+#include <type_traits>
 #include <functional>
 #include <string>
 #include <memory>
+#include <iterator>
+#include <stdexcept>
+#include <cstdint>
+#include "cache_storage.h"
+#include "cache_stats.h"
+#include "admission.h"
+#include "node_pool.h"
+#include "read_buffer.h"
 
 namespace cache
 {
+// 不使用二级缓存; 磁盘二级缓存见 segment_store.h
+struct NoSecondLevel {
+    static constexpr bool Enabled = false;
+};
+
 // 通用线程安全 LRU 缓存模板
+// 条目直接存放在链表节点中, 哈希表保存节点迭代器, 提升和删除都通过splice/erase在O(1)内完成
+// 链表节点和哈希表节点都从每个缓存独立的 SlabPool 分配, 淘汰释放的节点留给后续写入, 稳定运行后写入和淘汰不再访问堆
+// Admission 为准入策略(见 admission.h): 默认 NoAdmission 即普通 LRU; TinyLFUAdmission 为 W-TinyLFU,
+// 缓存分为窗口区、试用区和保护区三段, 主区满时按访问频率决定是否接纳窗口区淘汰出来的候选者
+// Promotion 为命中提升策略(见 read_buffer.h): 默认 ExactPromotion 每次命中在独占锁内提升;
+// BufferedPromotion 命中只持有共享锁并记入读缓冲, 在下一次写入或缓冲写满时批量提升
+// SecondLevel 为二级缓存(如 SegmentStore), 用 set_second_level 设置后: 从内存淘汰的条目写入二级缓存,
+// 内存未命中时从二级缓存取出并重新放入内存; 同一个 key 只存在于其中一层, Deleter 在值离开内存时回调
+// 读写二级缓存都在释放锁之后进行, 写入完成前该条目仍可从待写入记录中取回
 template <typename Key, 
           typename Value, 
-          typename Hash = std::hash<Key>,
-          typename KeyEqual = std::equal_to<Key>>
+          typename Hash = DefaultHash<Key>,
+          typename KeyEqual = DefaultEqual<Key>,
+          typename Storage = NodeStorage,
+          typename Admission = NoAdmission,
+          typename Promotion = ExactPromotion,
+          typename SecondLevel = NoSecondLevel>
 class LRUCache {
 public:
     using Deleter = std::function<void(const Key &key, Value value)>;
+    using Weigher = std::function<size_t(const Key &key, const Value &value)>;
 
     // 构造函数
     explicit LRUCache(
         size_t capacity,
         Deleter deleter = nullptr
-    ) : capacity_(capacity), deleter_(deleter) {
+    ) : capacity_(capacity), max_weight_(SIZE_MAX), total_weight_(0),
+        window_(ItemAllocator(&pool_)), probation_(ItemAllocator(&pool_)), protected_(ItemAllocator(&pool_)),
+        cache_map_(detail::make_map<ItemMap>(MapAllocator(&pool_))), deleter_(deleter), admission_(capacity),
+        spill_version_(0), owns_second_level_(false) {
         if (capacity == 0) {
             throw std::invalid_argument("Capacity must be greater than 0");
         }
+        window_capacity_ = Admission::WindowCapacity(capacity);
+        window_capacity_ = window_capacity_ < capacity ? window_capacity_ : capacity;
+        main_capacity_ = capacity - window_capacity_;
+        protected_capacity_ = main_capacity_ * 8 / 10;
     }
 
-    // 析构函数 - 自动清理所有资源
+    // 析构函数 - 自动清理所有资源, 与其他缓存共用的二级缓存不清空
     ~LRUCache() {
         clear();
     }
 
     // 添加或更新元素
     void put(const Key& key, Value value) {
-        std::lock_guard<std::mutex> lock(mutex_);
+        auto lock = spill_lock();
+        stats_.Put();
+        drain();
+        record(key);
         
         auto it = cache_map_.find(key);
         if (it != cache_map_.end()) {
-            // 更新现有元素
-            it->second->value = value;
+            // 更新现有元素, 权重按新值重新计算
+            auto& item = *it->second;
+            item.value = std::move(value);
+            total_weight_ -= item.weight;
+            item.weight = weigh(item.key, item.value);
+            total_weight_ += item.weight;
+            if (item.weight > max_weight_) {
+                evict_item(segment(item.segment), it->second);
+                return;
+            }
             // 移动到最近使用位置
             move_to_front(it->second);
+            evict();
             return;
         }
 
-        // 检查容量并淘汰最旧项
-        if (cache_list_.size() >= capacity_) {
-            evict_last();
+        // 新值覆盖二级缓存中的旧值
+        if constexpr (SecondLevel::Enabled) {
+            discard_pending(key);
+            if (second_level_) {
+                second_level_->Remove(key);
+            }
         }
-
-        // 添加新项到列表头部
-        auto new_item = std::make_shared<CacheItem>(key, value);
-        cache_list_.push_front(new_item);
-        cache_map_[key] = new_item;
+        insert(key, std::move(value));
     }
 
     // 获取元素（可选是否标记为使用）
-    Value get(const Key& key, bool mark_used = true) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        auto it = cache_map_.find(key);
-        if (it == cache_map_.end()) {
-            return nullptr; // 或根据 Value 类型返回默认值
+    template <typename Q = Key>
+    Value get(const Q& key, bool mark_used = true) {
+        if constexpr (Promotion::Buffered) {
+            return get_buffered(key, mark_used);
         }
-        
-        if (mark_used) {
-            move_to_front(it->second);
+        {
+            auto lock = spill_lock();
+            if (mark_used) {
+                record(key);
+            }
+            
+            auto it = detail::find_key(cache_map_, key);
+            if (it != cache_map_.end()) {
+                stats_.Hit();
+                if (mark_used) {
+                    move_to_front(it->second);
+                }
+                return it->second->value;
+            }
         }
-        
-        return it->second->value;
+        Value value = nullptr;
+        if (take(key, mark_used, value)) {
+            stats_.Hit();
+            return value;
+        }
+        stats_.Miss();
+        return nullptr; // 或根据 Value 类型返回默认值
     }
 
     // 检查是否存在元素
-    bool contains(const Key& key) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return cache_map_.find(key) != cache_map_.end();
+    template <typename Q = Key>
+    bool contains(const Q& key) {
+        auto lock = read_lock();
+        if (detail::find_key(cache_map_, key) != cache_map_.end()) {
+            return true;
+        }
+        if constexpr (SecondLevel::Enabled) {
+            auto pending = detail::find_key(pending_, key);
+            if (pending != pending_.end()) {
+                return !pending->second.stale;
+            }
+            return second_level_ && second_level_->Contains(key);
+        }
+        return false;
     }
 
     // 显式移除元素
-    bool remove(const Key& key) {
-        std::lock_guard<std::mutex> lock(mutex_);
+    template <typename Q = Key>
+    bool remove(const Q& key) {
+        auto lock = stats_.WriteLock(mutex_);
+        drain();
         
-        auto it = cache_map_.find(key);
+        auto it = detail::find_key(cache_map_, key);
         if (it == cache_map_.end()) {
+            if constexpr (SecondLevel::Enabled) {
+                auto removed = discard_pending(key);
+                return (second_level_ && second_level_->Remove(key)) || removed;
+            }
             return false;
         }
 
-        auto item = it->second;
-        // 从映射和列表中移除
+        // 先把节点摘到临时链表, 从映射和列表中移除后再回调
+        ItemList removed(window_.get_allocator());
+        removed.splice(removed.begin(), segment(it->second->segment), it->second);
         cache_map_.erase(it);
-        cache_list_.remove(item);
+        total_weight_ -= removed.front().weight;
         
         // 销毁资源
         if (deleter_) {
-            deleter_(item->key, item->value);
+            deleter_(removed.front().key, removed.front().value);
         }
         
         return true;
     }
 
-    // 清空整个缓存
+    // 清空整个缓存; 二级缓存只在由本缓存独占时清空
     void clear() {
-        std::lock_guard<std::mutex> lock(mutex_);
+        auto lock = stats_.WriteLock(mutex_);
+        drain();
         
         if (deleter_) {
-            for (auto& item : cache_list_) {
-                deleter_(item->key, item->value);
+            for (auto list : {&window_, &probation_, &protected_}) {
+                for (auto& item : *list) {
+                    deleter_(item.key, item.value);
+                }
             }
         }
         
-        cache_list_.clear();
+        window_.clear();
+        probation_.clear();
+        protected_.clear();
         cache_map_.clear();
+        total_weight_ = 0;
+        if constexpr (SecondLevel::Enabled) {
+            // 正在写入的条目写完后由 spill 删除
+            for (auto& pending : pending_) {
+                pending.second.value = Value();
+                pending.second.stale = true;
+            }
+            for (auto& taking : takes_) {
+                taking.second.generation++;
+            }
+            if (second_level_ && owns_second_level_) {
+                second_level_->Clear();
+            }
+        }
     }
 
-    // 获取当前大小
+    // 获取当前大小, 只计内存中的条目
     size_t size() const {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return cache_list_.size();
+        auto lock = read_lock();
+        return window_.size() + probation_.size() + protected_.size();
     }
 
     // 获取容量
@@ -125,41 +224,626 @@ public:
         return capacity_;
     }
 
+    // 按权重限制容量: 总权重超过 max_weight 时继续淘汰, 直到放得下; capacity 仍然限制条目数
+    // weigher 返回条目的权重(如字节数), 在写入和覆盖时计算; 单个条目超过 max_weight 时只淘汰它自己, 不会挤出其他条目
+    void set_max_weight(size_t max_weight, Weigher weigher) {
+        auto lock = spill_lock();
+        drain();
+        max_weight_ = max_weight;
+        weigher_ = weigher;
+        total_weight_ = 0;
+        for (auto list : {&window_, &probation_, &protected_}) {
+            for (auto it = list->begin(); it != list->end();) {
+                auto item = it++;
+                item->weight = weigh(item->key, item->value);
+                total_weight_ += item->weight;
+                if (item->weight > max_weight_) {
+                    evict_item(*list, item);
+                }
+            }
+        }
+        evict();
+    }
+
+    size_t weight() const {
+        auto lock = read_lock();
+        return total_weight_;
+    }
+
+    size_t max_weight() const {
+        return max_weight_;
+    }
+
+    // 设置二级缓存, 传入空指针取消; 二级缓存中已有的条目保留
+    // owned 为 false 表示二级缓存与其他缓存共用(如 ShardedLRUCache 的各分片), clear 和析构时不清空
+    void set_second_level(std::shared_ptr<SecondLevel> second_level, bool owned = true) {
+        auto lock = stats_.WriteLock(mutex_);
+        second_level_ = second_level;
+        owns_second_level_ = owned;
+    }
+
+    // 开启/关闭统计, 默认关闭
+    void enable_stats(bool enabled = true) {
+        stats_.Enable(enabled);
+    }
+
+    CacheStats stats() const {
+        return stats_.Snapshot();
+    }
+
 private:
+    enum Segment : uint8_t {
+        WindowSegment,
+        ProbationSegment,
+        ProtectedSegment,
+    };
+
     struct CacheItem {
         Key key;
         Value value;
+        Segment segment;
+        size_t weight;
         
-        CacheItem(const Key& k, Value v) : key(k), value(v) {}
+        CacheItem(const Key& k, Value v) : key(k), value(std::move(v)), segment(WindowSegment), weight(0) {}
+    };
+
+    // 所有链表共用同一个内存池, 分配器相等, 节点可以在链表之间 splice
+    using ItemAllocator = PoolAllocator<CacheItem>;
+    using ItemList = std::list<CacheItem, ItemAllocator>;
+    using ItemIterator = typename ItemList::iterator;
+    using MapAllocator = PoolAllocator<std::pair<const Key, ItemIterator>>;
+    using ItemMap = typename Storage::template Map<Key, ItemIterator, Hash, KeyEqual, MapAllocator>;
+
+    ItemList& segment(Segment which) {
+        return which == WindowSegment ? window_ : which == ProbationSegment ? probation_ : protected_;
+    }
+
+    using Mutex = typename std::conditional<Promotion::Buffered, std::shared_mutex, std::mutex>::type;
+
+    // 已从内存淘汰、尚未写入二级缓存的条目; version 区分同一个 key 的多次淘汰
+    struct Spill {
+        Key key;
+        Value value;
+        uint64_t version;
+    };
+
+    // stale 表示写入期间该 key 被重新写入、删除或取回, 二级缓存中的这份写完后要删除
+    // 同一个 key 可能先后被淘汰多次, spilling 为尚未写完的次数, 全部写完才删除记录, 此前读取都从记录取回
+    struct Pending {
+        Value value;
+        uint64_t version = 0;
+        bool stale = false;
+        size_t spilling = 0;
+    };
+
+    // 不持锁读取二级缓存的 key: generation 在该 key 被写入、删除或清空时递增, 读完后据此判断取回的值是否仍然有效
+    struct Taking {
+        size_t count = 0;
+        uint64_t generation = 0;
     };
 
-    using ItemPtr = std::shared_ptr<CacheItem>;
-    using ItemList = std::list<ItemPtr>;
-    
-    void evict_last() {
-        if (cache_list_.empty()) return;
+    // 读缓冲中的一条访问记录: 不拷贝 key, 只记哈希(用于准入频率)和命中的节点
+    // 节点只在共享锁内记入, 所有可能删除节点的独占锁操作都先排空读缓冲, 因此排空时节点一定仍在缓存中
+    struct Read {
+        size_t hash = 0;
+        ItemIterator item;
+        bool hit = false;
+    };
+
+    // 可能淘汰条目的写操作使用: 析构时在锁内取出淘汰的条目, 释放锁之后再写入二级缓存
+    class SpillLock {
+    public:
+        explicit SpillLock(LRUCache* cache) : cache_(cache), lock_(cache->stats_.WriteLock(cache->mutex_)) {}
+
+        SpillLock(const SpillLock&) = delete;
+        SpillLock& operator=(const SpillLock&) = delete;
+
+        ~SpillLock() {
+            if constexpr (SecondLevel::Enabled) {
+                if (cache_->spills_.empty()) {
+                    return;
+                }
+                std::vector<Spill> spills;
+                spills.swap(cache_->spills_);
+                auto second_level = cache_->second_level_;
+                lock_.unlock();
+                cache_->spill(*second_level, spills);
+            }
+        }
+
+    private:
+        LRUCache* cache_;
+        std::unique_lock<Mutex> lock_;
+    };
+
+    SpillLock spill_lock() {
+        return SpillLock(this);
+    }
+
+    // 不持有锁时调用: 先写入二级缓存, 再持锁核对; 写入期间该 key 被重新写入、删除、取回或再次淘汰时删除刚写入的这份
+    // 同一个 key 的多次写入先后无法确定, 旧的一次写完时删除二级缓存中的这个 key(可能连带删除新的一份, 最多多一次未命中)
+    // 待写入记录保留到该 key 的所有写入都完成, 期间读取只从记录取回, 因此不会读到二级缓存中的旧值
+    void spill(SecondLevel& second_level, std::vector<Spill>& spills) {
+        for (auto& spill : spills) {
+            second_level.Put(spill.key, spill.value);
+        }
+        auto lock = stats_.WriteLock(mutex_);
+        for (auto& spill : spills) {
+            auto it = pending_.find(spill.key);
+            if (it->second.version != spill.version || it->second.stale) {
+                second_level.Remove(spill.key);
+            }
+            if (--it->second.spilling == 0) {
+                pending_.erase(it);
+            }
+        }
+    }
+
+    // 调用方需持有独占锁; 作废正在写入二级缓存的条目和正在读取的二级缓存值, 返回待写入记录作废前是否有效
+    template <typename Q>
+    bool discard_pending(const Q& key) {
+        auto taking = detail::find_key(takes_, key);
+        if (taking != takes_.end()) {
+            taking->second.generation++;
+        }
+        auto it = detail::find_key(pending_, key);
+        if (it == pending_.end() || it->second.stale) {
+            return false;
+        }
+        it->second.value = Value();
+        it->second.stale = true;
+        return true;
+    }
+
+    // 缓冲提升时只读操作持有共享锁
+    auto read_lock() const {
+        if constexpr (Promotion::Buffered) {
+            return stats_.ReadLock(mutex_);
+        } else {
+            return stats_.WriteLock(mutex_);
+        }
+    }
+
+    // 共享锁内查找并记入读缓冲, 命中和未命中都记录(未命中也要计入准入频率); 条带写满时只有取得排空资格的线程尝试独占锁, 拿得到就顺便排空
+    // 内存未命中且设置了二级缓存时由 take 从二级缓存取回, 取回的条目已在最近使用位置
+    template <typename Q>
+    Value get_buffered(const Q& key, bool mark_used) {
+        Value value = nullptr;
+        bool found = false;
+        bool second_level = false;
+        bool full = false;
+        Read read;
+        if (mark_used) {
+            if constexpr (Admission::Enabled) {
+                read.hash = detail::hash_key<Key>(Hash{}, key);
+            }
+        }
+        {
+            auto lock = stats_.ReadLock(mutex_);
+            auto it = detail::find_key(cache_map_, key);
+            if (it != cache_map_.end()) {
+                value = it->second->value;
+                found = true;
+                read.item = it->second;
+                read.hit = true;
+            }
+            if constexpr (SecondLevel::Enabled) {
+                second_level = second_level_ != nullptr;
+            }
+            if (mark_used) {
+                full = reads_.Offer(read);
+            }
+        }
+        if (!found && second_level) {
+            found = take(key, mark_used, value);
+        }
+        if (found) {
+            stats_.Hit();
+        } else {
+            stats_.Miss();
+        }
+        if (full) {
+            std::unique_lock<Mutex> lock(mutex_, std::try_to_lock);
+            if (lock.owns_lock()) {
+                drain();
+            } else {
+                reads_.ReleaseDrain();
+            }
+        }
+        return value;
+    }
+
+    // 调用方需持有独占锁; 按记录顺序补做频率统计和提升
+    void drain() {
+        if constexpr (Promotion::Buffered) {
+            reads_.Drain([this](const Read& read) {
+                if constexpr (Admission::Enabled) {
+                    admission_.Record(read.hash);
+                }
+                if (read.hit) {
+                    move_to_front(read.item);
+                }
+            });
+        }
+    }
+
+    template <typename Q>
+    void record(const Q& key) {
+        if constexpr (Admission::Enabled) {
+            admission_.Record(detail::hash_key<Key>(Hash{}, key));
+        }
+    }
+
+    // 添加新项到窗口区头部, 超出容量时淘汰; 新项本身超重时直接淘汰新项
+    void insert(const Key& key, Value value) {
+        window_.emplace_front(key, std::move(value));
+        window_.front().weight = weigh(key, window_.front().value);
+        total_weight_ += window_.front().weight;
+        cache_map_.emplace(key, window_.begin());
+        if (window_.front().weight > max_weight_) {
+            evict_item(window_, window_.begin());
+            return;
+        }
+        evict();
+    }
+
+    // 调用方需持有独占锁; 正在写入二级缓存的条目直接从待写入记录取回放回内存, 不读二级缓存
+    // 返回 false 表示没有待写入记录; 记录已作废时 found 为 false, 二级缓存中的那份写完后会被删除, 不能再去读
+    template <typename Q>
+    bool promote_pending(const Q& key, Value& value, bool& found) {
+        auto pending = detail::find_key(pending_, key);
+        if (pending == pending_.end()) {
+            return false;
+        }
+        found = !pending->second.stale;
+        if (found) {
+            Key pending_key = pending->first;
+            value = pending->second.value;
+            discard_pending(pending_key);
+            insert(pending_key, value);
+        }
+        return true;
+    }
+
+    // 不持有锁时调用, 内存未命中后从二级缓存取回并放回内存, 可能随即把其他条目挤到二级缓存
+    // 读二级缓存时不持有锁, 读完重新持锁核对: 期间其他线程已放回内存时使用内存中的值,
+    // 该 key 被写入、删除或清空时丢弃取回的值
+    template <typename Q>
+    bool take(const Q& key, bool mark_used, Value& value) {
+        if constexpr (SecondLevel::Enabled) {
+            bool found = false;
+            std::shared_ptr<SecondLevel> second_level;
+            uint64_t generation = 0;
+            {
+                auto lock = spill_lock();
+                drain();
+                if (find_memory(key, mark_used, value)) {
+                    return true;
+                }
+                if (promote_pending(key, value, found)) {
+                    return found;
+                }
+                if (!second_level_) {
+                    return false;
+                }
+                second_level = second_level_;
+                auto taking = detail::find_key(takes_, key);
+                if (taking == takes_.end()) {
+                    taking = takes_.emplace(Key(key), Taking()).first;
+                }
+                taking->second.count++;
+                generation = taking->second.generation;
+            }
+
+            Key stored_key;
+            Value taken = nullptr;
+            bool took = second_level->Take(key, stored_key, taken);
+
+            auto lock = spill_lock();
+            drain();
+            auto taking = detail::find_key(takes_, key);
+            bool valid = taking->second.generation == generation;
+            if (--taking->second.count == 0) {
+                takes_.erase(taking);
+            }
+            if (find_memory(key, mark_used, value)) {
+                return true;
+            }
+            if (promote_pending(key, value, found)) {
+                return found;
+            }
+            if (!took || !valid) {
+                return false;
+            }
+            value = taken;
+            insert(stored_key, std::move(taken));
+            return true;
+        }
+        return false;
+    }
+
+    // 调用方需持有独占锁
+    template <typename Q>
+    bool find_memory(const Q& key, bool mark_used, Value& value) {
+        auto it = detail::find_key(cache_map_, key);
+        if (it == cache_map_.end()) {
+            return false;
+        }
+        value = it->second->value;
+        if (mark_used) {
+            move_to_front(it->second);
+        }
+        return true;
+    }
+
+    size_t weigh(const Key& key, const Value& value) const {
+        return weigher_ ? weigher_(key, value) : 0;
+    }
+
+    // 先按条目数淘汰, 再按权重淘汰
+    void evict() {
+        if (window_.size() > window_capacity_) {
+            admit();
+        }
+        // 超重时窗口区最旧项与主区最旧项比较频率, 淘汰其中之一; 普通 LRU 下主区为空, 即淘汰最旧项
+        while (total_weight_ > max_weight_ && !cache_map_.empty()) {
+            auto& victims = probation_.empty() ? protected_ : probation_;
+            if (victims.empty()) {
+                evict_last(window_);
+            } else if (window_.empty() || admission_.Admit(Hash{}(window_.back().key), Hash{}(victims.back().key))) {
+                evict_last(victims);
+            } else {
+                evict_last(window_);
+            }
+        }
+    }
+
+    // 窗口区溢出时, 其最旧项作为候选者进入主区; 主区已满时候选者与主区最旧项比较频率, 淘汰其中之一
+    void admit() {
+        auto candidate = std::prev(window_.end());
+        if (probation_.size() + protected_.size() < main_capacity_) {
+            candidate->segment = ProbationSegment;
+            probation_.splice(probation_.begin(), window_, candidate);
+            return;
+        }
+        auto& victims = probation_.empty() ? protected_ : probation_;
+        if (victims.empty() || !admission_.Admit(Hash{}(candidate->key), Hash{}(victims.back().key))) {
+            evict_last(window_);
+            return;
+        }
+        evict_last(victims);
+        candidate->segment = ProbationSegment;
+        probation_.splice(probation_.begin(), window_, candidate);
+    }
+
+    void evict_last(ItemList& list) {
+        evict_item(list, std::prev(list.end()));
+    }
+
+    void evict_item(ItemList& list, ItemIterator item) {
+        ItemList removed(window_.get_allocator());
+        removed.splice(removed.begin(), list, item);
+        cache_map_.erase(removed.front().key);
+        total_weight_ -= removed.front().weight;
+        stats_.Evict();
         
-        auto last = cache_list_.back();
-        cache_map_.erase(last->key);
-        cache_list_.pop_back();
+        // 二级缓存由 SpillLock 在释放锁后写入, 这里只记下待写入的条目
+        if constexpr (SecondLevel::Enabled) {
+            if (second_level_) {
+                auto version = ++spill_version_;
+                auto& pending = pending_[removed.front().key];
+                pending.value = removed.front().value;
+                pending.version = version;
+                pending.stale = false;
+                pending.spilling++;
+                spills_.push_back(Spill{removed.front().key, removed.front().value, version});
+            }
+        }
         
         if (deleter_) {
-            deleter_(last->key, last->value);
+            deleter_(removed.front().key, removed.front().value);
         }
     }
 
-    void move_to_front(const ItemPtr& item) {
-        // 从当前位置移除
-        cache_list_.remove(item);
-        // 添加到头部
-        cache_list_.push_front(item);
+    // 节点原地挪动, 不拷贝不分配; 试用区再次命中的升入保护区, 保护区超额时最旧项降回试用区
+    void move_to_front(ItemIterator item) {
+        switch (item->segment) {
+        case WindowSegment:
+            window_.splice(window_.begin(), window_, item);
+            break;
+        case ProbationSegment:
+            item->segment = ProtectedSegment;
+            protected_.splice(protected_.begin(), probation_, item);
+            if (protected_.size() > protected_capacity_) {
+                auto demoted = std::prev(protected_.end());
+                demoted->segment = ProbationSegment;
+                probation_.splice(probation_.begin(), protected_, demoted);
+            }
+            break;
+        case ProtectedSegment:
+            protected_.splice(protected_.begin(), protected_, item);
+            break;
+        }
     }
 
     size_t capacity_;
-    ItemList cache_list_; // 最近使用的在列表前端
-    std::unordered_map<Key, ItemPtr, Hash, KeyEqual> cache_map_;
+    size_t window_capacity_;
+    size_t main_capacity_;
+    size_t protected_capacity_;
+    size_t max_weight_;
+    size_t total_weight_;
+    SlabPool pool_; // 必须在链表和哈希表之前声明, 最后析构
+    ItemList window_;     // 各段中最近使用的在列表前端
+    ItemList probation_;
+    ItemList protected_;
+    ItemMap cache_map_;
     Deleter deleter_;
-    mutable std::mutex mutex_; // 保证线程安全
+    Weigher weigher_;
+    Admission admission_;
+    typename Promotion::template Buffer<Read> reads_;
+    std::shared_ptr<SecondLevel> second_level_;
+    std::vector<Spill> spills_; // 本次持锁期间淘汰、待写入二级缓存的条目
+    std::unordered_map<Key, Pending, Hash, KeyEqual> pending_; // 正在写入二级缓存的条目
+    std::unordered_map<Key, Taking, Hash, KeyEqual> takes_; // 正在不持锁读取二级缓存的 key
+    uint64_t spill_version_;
+    bool owns_second_level_;
+    mutable Mutex mutex_; // 保证线程安全
+    mutable CacheStatsRecorder stats_;
+};
+
+// 分片 LRU 缓存: 按 key 哈希路由到独立加锁的 LRUCache, 容量平均分到各分片
+// 每个分片独立淘汰, 整体是近似 LRU; Deleter 在所属分片的锁内回调
+template <typename Key, 
+          typename Value, 
+          typename Hash = DefaultHash<Key>,
+          typename KeyEqual = DefaultEqual<Key>,
+          typename Storage = NodeStorage,
+          typename Admission = NoAdmission,
+          typename Promotion = ExactPromotion,
+          typename SecondLevel = NoSecondLevel>
+class ShardedLRUCache {
+public:
+    using Shard = LRUCache<Key, Value, Hash, KeyEqual, Storage, Admission, Promotion, SecondLevel>;
+    using Deleter = typename Shard::Deleter;
+    using Weigher = typename Shard::Weigher;
+    static const size_t DefaultShardCount = 16;
+
+    // 分片数向上取整为 2 的幂, 容量小于分片数时减少分片, 保证每个分片至少容纳一项
+    explicit ShardedLRUCache(
+        size_t capacity,
+        Deleter deleter = nullptr,
+        size_t shard_count = DefaultShardCount
+    ) : capacity_(capacity) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Capacity must be greater than 0");
+        }
+        if (shard_count == 0) {
+            throw std::invalid_argument("Shard count must be greater than 0");
+        }
+        size_t count = 1;
+        while (count < shard_count) {
+            count <<= 1;
+        }
+        while (count > capacity) {
+            count >>= 1;
+        }
+        mask_ = count - 1;
+        // 余数分给前几个分片, 总容量与 capacity 一致
+        for (size_t i = 0; i < count; ++i) {
+            shards_.emplace_back(new Slot(capacity / count + (i < capacity % count ? 1 : 0), deleter));
+        }
+    }
+
+    // 与 LRUCache 一致, 独占的二级缓存随缓存一起清空
+    ~ShardedLRUCache() {
+        clear();
+    }
+
+    void put(const Key& key, Value value) {
+        shard(key).put(key, std::move(value));
+    }
+
+    template <typename Q = Key>
+    Value get(const Q& key, bool mark_used = true) {
+        return shard(key).get(key, mark_used);
+    }
+
+    template <typename Q = Key>
+    bool contains(const Q& key) {
+        return shard(key).contains(key);
+    }
+
+    template <typename Q = Key>
+    bool remove(const Q& key) {
+        return shard(key).remove(key);
+    }
+
+    // 逐个分片清空, 不是原子快照; 二级缓存只在由本缓存独占时清空
+    void clear() {
+        for (auto& slot : shards_) {
+            slot->cache.clear();
+        }
+        if constexpr (SecondLevel::Enabled) {
+            if (second_level_ && owns_second_level_) {
+                second_level_->Clear();
+            }
+        }
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (auto& slot : shards_) {
+            total += slot->cache.size();
+        }
+        return total;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    // 总权重平均分到各分片, 每个分片独立按权重淘汰
+    void set_max_weight(size_t max_weight, Weigher weigher) {
+        auto count = shards_.size();
+        for (size_t i = 0; i < count; ++i) {
+            shards_[i]->cache.set_max_weight(max_weight / count + (i < max_weight % count ? 1 : 0), weigher);
+        }
+    }
+
+    size_t weight() const {
+        size_t total = 0;
+        for (auto& slot : shards_) {
+            total += slot->cache.weight();
+        }
+        return total;
+    }
+
+    // 所有分片共用一个二级缓存, 各分片的 key 互不重叠; owned 含义与 LRUCache::set_second_level 相同
+    void set_second_level(std::shared_ptr<SecondLevel> second_level, bool owned = true) {
+        for (auto& slot : shards_) {
+            slot->cache.set_second_level(second_level, false);
+        }
+        second_level_ = second_level;
+        owns_second_level_ = owned;
+    }
+
+    size_t shard_count() const {
+        return shards_.size();
+    }
+
+    void enable_stats(bool enabled = true) {
+        for (auto& slot : shards_) {
+            slot->cache.enable_stats(enabled);
+        }
+    }
+
+    // 汇总所有分片的统计
+    CacheStats stats() const {
+        CacheStats total;
+        for (auto& slot : shards_) {
+            total += slot->cache.stats();
+        }
+        return total;
+    }
+
+private:
+    // 按缓存行对齐, 避免相邻分片的锁伪共享
+    struct alignas(64) Slot {
+        Shard cache;
+
+        Slot(size_t capacity, Deleter deleter) : cache(capacity, deleter) {}
+    };
+
+    template <typename Q>
+    Shard& shard(const Q& key) {
+        return shards_[detail::shard_index(detail::hash_key<Key>(Hash{}, key), mask_)]->cache;
+    }
+
+    size_t capacity_;
+    size_t mask_;
+    std::vector<std::unique_ptr<Slot>> shards_;
+    std::shared_ptr<SecondLevel> second_level_;
+    bool owns_second_level_ = false;
 };
 }
 
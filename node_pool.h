@@ -0,0 +1,167 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace cache
+{
+// 定长块内存池: 按块大小分类, 每类一条空闲链表, 块从成批申请的slab中切出
+// 释放的块只回到空闲链表, slab在内存池析构时才归还; 容量固定的缓存在稳定淘汰阶段不再访问堆
+// 非线程安全, 由调用方加锁
+class SlabPool
+{
+public:
+    explicit SlabPool(size_t max_slab_blocks = DefaultMaxSlabBlocks)
+    :
+    _max_slab_blocks(max_slab_blocks > 0 ? max_slab_blocks : 1)
+    {
+    }
+
+    ~SlabPool()
+    {
+        for (auto slab : this->_slabs)
+        {
+            ::operator delete(slab);
+        }
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    void *Allocate(size_t size)
+    {
+        auto &size_class = this->find(size);
+        if (!size_class.free)
+        {
+            this->grow(size_class);
+        }
+        auto block = size_class.free;
+        size_class.free = block->next;
+        return block;
+    }
+
+    void Deallocate(void *pointer, size_t size)
+    {
+        auto &size_class = this->find(size);
+        auto block = static_cast<FreeBlock *>(pointer);
+        block->next = size_class.free;
+        size_class.free = block;
+    }
+
+private:
+    static const size_t DefaultMaxSlabBlocks = 4096;
+    static const size_t MinSlabBlocks = 16;
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    struct SizeClass
+    {
+        size_t      size;
+        size_t      slab_blocks;    //下一个slab的块数, 从MinSlabBlocks开始翻倍
+        FreeBlock   *free;
+    };
+
+    //块大小按max_align_t对齐; 一个缓存只有少数几种节点大小, 线性查找即可
+    SizeClass &find(size_t size)
+    {
+        size = (size + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+        for (auto &size_class : this->_classes)
+        {
+            if (size_class.size == size)
+            {
+                return size_class;
+            }
+        }
+        this->_classes.push_back({size, MinSlabBlocks, nullptr});
+        return this->_classes.back();
+    }
+
+    void grow(SizeClass &size_class)
+    {
+        auto slab = static_cast<char *>(::operator new(size_class.size * size_class.slab_blocks));
+        this->_slabs.push_back(slab);
+        for (size_t i = size_class.slab_blocks; i > 0; --i)
+        {
+            auto block = reinterpret_cast<FreeBlock *>(slab + (i - 1) * size_class.size);
+            block->next = size_class.free;
+            size_class.free = block;
+        }
+        size_class.slab_blocks = size_class.slab_blocks * 2 < this->_max_slab_blocks ? size_class.slab_blocks * 2 : this->_max_slab_blocks;
+    }
+
+    size_t                  _max_slab_blocks;
+    std::vector<SizeClass>  _classes;
+    std::vector<void *>     _slabs;
+};
+
+// 从SlabPool分配单个节点的STL分配器, 用于std::list/std::unordered_map的节点
+// 数组分配(如哈希桶)和超对齐类型仍走默认分配器; 使用同一个内存池的分配器相等, 容器之间可以splice
+template<class T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    template<class U>
+    struct rebind
+    {
+        using other = PoolAllocator<U>;
+    };
+
+    explicit PoolAllocator(SlabPool *pool)
+    :
+    _pool(pool)
+    {
+    }
+
+    template<class U>
+    PoolAllocator(const PoolAllocator<U> &other)
+    :
+    _pool(other.Pool())
+    {
+    }
+
+    T *allocate(size_t count)
+    {
+        if (count == 1 && alignof(T) <= alignof(std::max_align_t))
+        {
+            return static_cast<T *>(this->_pool->Allocate(sizeof(T)));
+        }
+        return std::allocator<T>().allocate(count);
+    }
+
+    void deallocate(T *pointer, size_t count)
+    {
+        if (count == 1 && alignof(T) <= alignof(std::max_align_t))
+        {
+            this->_pool->Deallocate(pointer, sizeof(T));
+            return;
+        }
+        std::allocator<T>().deallocate(pointer, count);
+    }
+
+    SlabPool *Pool() const
+    {
+        return this->_pool;
+    }
+
+    template<class U>
+    bool operator==(const PoolAllocator<U> &other) const
+    {
+        return this->_pool == other.Pool();
+    }
+
+    template<class U>
+    bool operator!=(const PoolAllocator<U> &other) const
+    {
+        return this->_pool != other.Pool();
+    }
+
+private:
+    SlabPool *_pool;
+};
+}
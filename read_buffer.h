@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <cstddef>
+#include "cache_stats.h"
+
+namespace cache
+{
+// 分条读缓冲: 每个线程固定写入一个条带, 条带各占独立缓存行
+// 写入方抢不到条带或条带已满时丢弃记录; 排空由调用方在缓存的独占锁内执行
+// 条带写满后只有一个写入方取得排空资格, 其余写入方只丢弃记录, 不会一起去抢缓存的独占锁
+template<class T>
+class ReadBuffer
+{
+public:
+    static const size_t Stripes = 16;
+    static const size_t StripeSize = 16;
+
+    //记录一次访问, item可以是能赋值给T的其他类型
+    //返回true表示条带已写满且本线程取得了排空资格, 调用方应尝试排空, 拿不到独占锁时调用ReleaseDrain归还资格
+    template<class U>
+    bool Offer(const U &item)
+    {
+        auto &stripe = this->_stripes[detail::thread_stripe(Stripes)];
+        if (stripe.busy.exchange(true, std::memory_order_acquire))
+        {
+            return false;
+        }
+        auto count = stripe.count.load(std::memory_order_relaxed);
+        if (count < StripeSize)
+        {
+            stripe.items[count++] = item;
+            stripe.count.store(count, std::memory_order_relaxed);
+        }
+        auto full = count == StripeSize;
+        stripe.busy.store(false, std::memory_order_release);
+        return full && !stripe.draining.exchange(true, std::memory_order_acquire);
+    }
+
+    //Offer返回true但没有排空时调用, 让之后写入该条带的线程可以再次尝试
+    void ReleaseDrain()
+    {
+        this->_stripes[detail::thread_stripe(Stripes)].draining.store(false, std::memory_order_release);
+    }
+
+    //依次对每条记录调用apply并清空缓冲; 写入方只在条带上停留几条指令, 这里等待即可
+    template<class Apply>
+    void Drain(const Apply &apply)
+    {
+        for (auto &stripe : this->_stripes)
+        {
+            //空条带不加锁直接跳过, 刚写入的记录留到下次排空
+            if (stripe.count.load(std::memory_order_relaxed) == 0)
+            {
+                continue;
+            }
+            while (stripe.busy.exchange(true, std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+            auto count = stripe.count.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; ++i)
+            {
+                apply(stripe.items[i]);
+            }
+            stripe.count.store(0, std::memory_order_relaxed);
+            stripe.busy.store(false, std::memory_order_release);
+            stripe.draining.store(false, std::memory_order_release);
+        }
+    }
+
+private:
+    struct alignas(64) Stripe
+    {
+        std::atomic<bool>   busy{false};
+        std::atomic<bool>   draining{false};    //写满后已有线程取得排空资格
+        std::atomic<size_t> count{0};       //只在持有busy时修改
+        T                   items[StripeSize];
+    };
+
+    Stripe _stripes[Stripes];
+};
+
+// LRUCache命中后的提升策略
+// 精确提升: 每次命中在独占锁内把条目挪到最近使用位置
+struct ExactPromotion
+{
+    static constexpr bool Buffered = false;
+
+    template<class K>
+    struct Buffer
+    {
+    };
+};
+
+// 缓冲提升: 命中只在共享锁内查找, 把key的哈希和命中的节点记入读缓冲(不拷贝key), 在下一次写入或某个缓冲写满时由持有独占锁的线程批量提升
+// 缓冲满或正被其他线程占用时直接丢弃记录, 读路径从不等待; 近似LRU
+struct BufferedPromotion
+{
+    static constexpr bool Buffered = true;
+
+    template<class K>
+    using Buffer = ReadBuffer<K>;
+};
+}
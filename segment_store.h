@@ -0,0 +1,510 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache_storage.h"
+#include "cache_snapshot.h"
+
+namespace cache
+{
+// 磁盘分段存储, 用作LRUCache的二级缓存(见LRUCache的SecondLevel参数), 也可以单独使用
+// 条目按 {key_len(4), value_len(4), key, value} 追加写入定长的段文件, 编解码与CacheSnapshot相同
+// 段文件创建时整段只读mmap, 写入走pwrite, 读取直接从映射中拷贝; 内存索引每项只有key和12字节的段号/偏移/长度
+// 覆盖、取出和删除只修改索引, 旧记录成为垃圾; 后台线程把垃圾占比达到compact_ratio的段中仍有效的记录搬到活动段, 然后删除该段
+// 总字节数超过max_bytes时整段丢弃最旧的段, 其中的条目直接失效
+// 按key哈希分成shard_count个分片, 每个分片有独立的锁、索引和段文件, max_bytes平均分到各分片;
+// 写盘只持有所在分片的锁, 其他分片的读写不受影响
+// 段文件只在进程内有效: 创建时覆盖同名文件, 析构时删除; 一个目录只能给一个存储使用
+template<class K, class V, class KeyCodec = SnapshotCodec<K>, class ValueCodec = SnapshotCodec<V>>
+class SegmentStore
+{
+public:
+    static constexpr bool Enabled = true;
+    static const size_t DefaultSegmentBytes = 64 << 20;
+    static constexpr double DefaultCompactRatio = 0.5;
+    static constexpr int64_t DefaultCompactInterval = 1000;  //毫秒
+    static const size_t DefaultShardCount = 8;
+
+    //分片数向上取整为2的幂; 段大小不超过单个分片容量的1/4, 丢弃最旧段时不会一次清掉太多条目
+    SegmentStore(const std::string &directory, size_t max_bytes, size_t segment_bytes = DefaultSegmentBytes,
+                 double compact_ratio = DefaultCompactRatio,
+                 std::chrono::milliseconds compact_interval = std::chrono::milliseconds(DefaultCompactInterval),
+                 size_t shard_count = DefaultShardCount)
+    :
+    _directory(directory),
+    _compact_ratio(compact_ratio),
+    _compact_interval(compact_interval),
+    _stopped(false)
+    {
+        size_t count = 1;
+        while (count < shard_count)
+        {
+            count <<= 1;
+        }
+        this->_mask = count - 1;
+        this->_shard_bytes = max_bytes / count;
+        this->_segment_bytes = segment_bytes < this->_shard_bytes / 4 ? segment_bytes : this->_shard_bytes / 4;
+        if (this->_segment_bytes <= HeaderSize || this->_segment_bytes > UINT32_MAX)
+        {
+            throw std::invalid_argument("Segment size must be within (8, 4G], max_bytes too small?");
+        }
+        if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            throw std::runtime_error("Failed to create segment directory: " + directory);
+        }
+        this->_shards.reset(new Shard[count]);
+        for (size_t i = 0; i < count; ++i)
+        {
+            this->_shards[i].number = static_cast<uint32_t>(i);
+        }
+        this->_compactor = std::thread(&SegmentStore::run, this);
+    }
+
+    ~SegmentStore()
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_stopped = true;
+            this->_condition.notify_all();
+        }
+        this->_compactor.join();
+    }
+
+    SegmentStore(const SegmentStore&) = delete;
+    SegmentStore& operator=(const SegmentStore&) = delete;
+
+    //写入或覆盖; value可以是V或std::shared_ptr<V>, 空指针不写入; 记录超过段大小或写盘失败时返回false, 旧值同时失效
+    template<class Value>
+    bool Put(const K &key, const Value &value)
+    {
+        auto address = value_address(value);
+        if (!address)
+        {
+            return false;
+        }
+        //编码在锁外进行, 缓冲区按线程复用
+        static thread_local std::string record;
+        record.assign(HeaderSize, '\0');
+        encode_field<KeyCodec>(key, record, 0);
+        encode_field<ValueCodec>(*address, record, sizeof(uint32_t));
+
+        auto &shard = this->shard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        Location location;
+        auto ok = this->append(shard, record.data(), record.size(), location);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            this->release(shard, it->second);
+            if (ok)
+            {
+                it->second = location;
+            }
+            else
+            {
+                shard.index.erase(it);
+            }
+        }
+        else if (ok)
+        {
+            shard.index.emplace(key, location);
+        }
+        this->trim(shard);
+        return ok;
+    }
+
+    //取出并删除; stored_key为存储中的key, 用于异构查找时还原原始key
+    template<class Q, class Value>
+    bool Take(const Q &key, K &stored_key, Value &value)
+    {
+        static thread_local std::string bytes;
+        {
+            auto &shard = this->shard(key);
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            auto it = detail::find_key(shard.index, key);
+            if (it == shard.index.end())
+            {
+                return false;
+            }
+            auto data = shard.segments.find(it->second.segment)->second->data + it->second.offset;
+            auto key_length = read<uint32_t>(data);
+            bytes.assign(data + HeaderSize + key_length, read<uint32_t>(data + sizeof(uint32_t)));
+            stored_key = it->first;
+            this->release(shard, it->second);
+            shard.index.erase(it);
+        }
+        //解码可能较慢(如JSON), 放在锁外
+        value = decode_value<Value>(bytes.data(), bytes.size());
+        return true;
+    }
+
+    template<class Q>
+    bool Contains(const Q &key)
+    {
+        auto &shard = this->shard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        return detail::find_key(shard.index, key) != shard.index.end();
+    }
+
+    template<class Q>
+    bool Remove(const Q &key)
+    {
+        auto &shard = this->shard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto it = detail::find_key(shard.index, key);
+        if (it == shard.index.end())
+        {
+            return false;
+        }
+        this->release(shard, it->second);
+        shard.index.erase(it);
+        return true;
+    }
+
+    //逐个分片清空, 不是原子快照
+    void Clear()
+    {
+        for (size_t i = 0; i <= this->_mask; ++i)
+        {
+            auto &shard = this->_shards[i];
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.index.clear();
+            shard.segments.clear();
+            shard.bytes = 0;
+        }
+    }
+
+    size_t Count()
+    {
+        size_t count = 0;
+        for (size_t i = 0; i <= this->_mask; ++i)
+        {
+            std::unique_lock<std::mutex> lock(this->_shards[i].mutex);
+            count += this->_shards[i].index.size();
+        }
+        return count;
+    }
+
+    //段文件已写入的总字节数, 包括尚未整理的垃圾
+    size_t Bytes()
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i <= this->_mask; ++i)
+        {
+            std::unique_lock<std::mutex> lock(this->_shards[i].mutex);
+            bytes += this->_shards[i].bytes;
+        }
+        return bytes;
+    }
+
+    //整理一遍各分片中垃圾占比达到阈值的段, 后台线程定期调用; 每搬一批记录释放一次锁, 不会长时间阻塞读写
+    void Compact()
+    {
+        for (size_t i = 0; i <= this->_mask; ++i)
+        {
+            auto &shard = this->_shards[i];
+            std::vector<uint32_t> victims;
+            {
+                std::unique_lock<std::mutex> lock(shard.mutex);
+                for (auto &pair : shard.segments)
+                {
+                    auto &segment = *pair.second;
+                    if (&segment != shard.segments.rbegin()->second.get() && segment.size > 0 &&
+                        static_cast<double>(segment.size - segment.live) >= segment.size * this->_compact_ratio)
+                    {
+                        victims.push_back(pair.first);
+                    }
+                }
+            }
+            for (auto id : victims)
+            {
+                this->compact(shard, id);
+            }
+        }
+    }
+
+private:
+    static const size_t HeaderSize = 2 * sizeof(uint32_t);
+    static const size_t CompactBatch = 256;
+
+    struct Location
+    {
+        uint32_t segment;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Segment
+    {
+        std::string path;
+        int         fd = -1;
+        const char  *data = nullptr;
+        size_t      size = 0;       //已写入的字节数
+        size_t      live = 0;       //仍被索引引用的字节数
+        size_t      mapped = 0;
+
+        ~Segment()
+        {
+            if (this->data)
+            {
+                ::munmap(const_cast<char *>(this->data), this->mapped);
+            }
+            if (this->fd >= 0)
+            {
+                ::close(this->fd);
+                ::unlink(this->path.c_str());
+            }
+        }
+    };
+
+    using SegmentMap = std::map<uint32_t, std::unique_ptr<Segment>>;
+    using Index = typename FlatStorage::template Map<K, Location>;
+
+    //按缓存行对齐, 避免相邻分片的锁伪共享
+    struct alignas(64) Shard
+    {
+        uint32_t    number = 0;     //分片序号, 用于段文件名
+        uint32_t    next_id = 0;
+        size_t      bytes = 0;
+        SegmentMap  segments;       //按段号从旧到新, 最后一段为活动段
+        Index       index;
+        std::mutex  mutex;
+    };
+
+    template<class Q>
+    Shard &shard(const Q &key)
+    {
+        return this->_shards[detail::shard_index(detail::hash_key<K>(DefaultHash<K>{}, key), this->_mask)];
+    }
+
+    template<class T>
+    static T read(const char *data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    static size_t record_length(const char *data)
+    {
+        return HeaderSize + read<uint32_t>(data) + read<uint32_t>(data + sizeof(uint32_t));
+    }
+
+    //字段追加到记录末尾, 长度回填到头部的header_offset处
+    template<class Codec, class T>
+    static void encode_field(const T &value, std::string &record, size_t header_offset)
+    {
+        auto pos = record.size();
+        Codec::Encode(value, record);
+        auto length = static_cast<uint32_t>(record.size() - pos);
+        std::memcpy(&record[header_offset], &length, sizeof(length));
+    }
+
+    //兼容两种值类型: shared_ptr可能为空, 值类型总是存在
+    static const V *value_address(const std::shared_ptr<V> &value)
+    {
+        return value.get();
+    }
+
+    static const V *value_address(const V &value)
+    {
+        return &value;
+    }
+
+    template<class Value>
+    static Value decode_value(const char *data, size_t size)
+    {
+        if constexpr (std::is_same<Value, std::shared_ptr<V>>::value)
+        {
+            return std::make_shared<V>(ValueCodec::Decode(data, size));
+        }
+        else
+        {
+            return ValueCodec::Decode(data, size);
+        }
+    }
+
+    //以下函数调用方需持有所在分片的锁
+    //写入活动段, 放不下时新建一段
+    bool append(Shard &shard, const char *data, size_t length, Location &location)
+    {
+        if (length > this->_segment_bytes)
+        {
+            return false;
+        }
+        if (shard.segments.empty() || shard.segments.rbegin()->second->size + length > this->_segment_bytes)
+        {
+            if (!this->roll(shard))
+            {
+                return false;
+            }
+        }
+        auto &active = *shard.segments.rbegin();
+        auto &segment = *active.second;
+        if (::pwrite(segment.fd, data, length, static_cast<off_t>(segment.size)) != static_cast<ssize_t>(length))
+        {
+            return false;
+        }
+        location = {active.first, static_cast<uint32_t>(segment.size), static_cast<uint32_t>(length)};
+        segment.size += length;
+        segment.live += length;
+        shard.bytes += length;
+        return true;
+    }
+
+    //段文件预先扩展为段大小(稀疏文件), 整段映射一次; MAP_SHARED映射与pwrite共用页缓存, 写入后立即可读
+    bool roll(Shard &shard)
+    {
+        auto id = shard.next_id++;
+        std::unique_ptr<Segment> segment(new Segment());
+        segment->path = this->_directory + "/" + std::to_string(shard.number) + "-" + std::to_string(id) + ".seg";
+        segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (segment->fd < 0)
+        {
+            return false;
+        }
+        if (::ftruncate(segment->fd, static_cast<off_t>(this->_segment_bytes)) != 0)
+        {
+            return false;
+        }
+        auto addr = ::mmap(nullptr, this->_segment_bytes, PROT_READ, MAP_SHARED, segment->fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            return false;
+        }
+        //二级缓存的读取是随机的, 关闭预读
+        ::madvise(addr, this->_segment_bytes, MADV_RANDOM);
+        segment->data = static_cast<const char *>(addr);
+        segment->mapped = this->_segment_bytes;
+        shard.segments.emplace(id, std::move(segment));
+        //上一段已封存, 唤醒整理线程检查; 不持有_mutex, 错过的唤醒由定期检查补上
+        this->_condition.notify_all();
+        return true;
+    }
+
+    void release(Shard &shard, const Location &location)
+    {
+        shard.segments.find(location.segment)->second->live -= location.length;
+    }
+
+    //索引仍指向该记录时返回索引项, 否则记录已是垃圾
+    typename Index::iterator find_record(Shard &shard, uint32_t id, const Segment &segment, size_t offset)
+    {
+        auto data = segment.data + offset;
+        auto it = shard.index.find(KeyCodec::Decode(data + HeaderSize, read<uint32_t>(data)));
+        if (it != shard.index.end() && (it->second.segment != id || it->second.offset != offset))
+        {
+            return shard.index.end();
+        }
+        return it;
+    }
+
+    //超出分片容量时丢弃最旧的段, 活动段保留
+    void trim(Shard &shard)
+    {
+        while (shard.bytes > this->_shard_bytes && shard.segments.size() > 1)
+        {
+            this->drop(shard, shard.segments.begin());
+        }
+    }
+
+    //段内还有有效记录时逐条从索引中删除
+    void drop(Shard &shard, typename SegmentMap::iterator found)
+    {
+        auto &segment = *found->second;
+        for (size_t offset = 0; segment.live > 0 && offset < segment.size; offset += record_length(segment.data + offset))
+        {
+            auto it = this->find_record(shard, found->first, segment, offset);
+            if (it != shard.index.end())
+            {
+                segment.live -= it->second.length;
+                shard.index.erase(it);
+            }
+        }
+        shard.bytes -= segment.size;
+        shard.segments.erase(found);
+    }
+
+    //把段内有效记录原样搬到活动段; 段在批次间隙被丢弃或清空时停止
+    void compact(Shard &shard, uint32_t id)
+    {
+        size_t offset = 0;
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            auto found = shard.segments.find(id);
+            if (found == shard.segments.end() || this->_stopped.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            auto &segment = *found->second;
+            for (size_t n = 0; n < CompactBatch && offset < segment.size && segment.live > 0; ++n)
+            {
+                auto length = record_length(segment.data + offset);
+                auto it = this->find_record(shard, id, segment, offset);
+                if (it != shard.index.end())
+                {
+                    segment.live -= length;
+                    Location location;
+                    if (this->append(shard, segment.data + offset, length, location))
+                    {
+                        it->second = location;
+                    }
+                    else
+                    {
+                        shard.index.erase(it);
+                    }
+                }
+                offset += length;
+            }
+            if (offset >= segment.size || segment.live == 0)
+            {
+                this->drop(shard, found);
+                return;
+            }
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (!this->_stopped)
+        {
+            this->_condition.wait_for(lock, this->_compact_interval);
+            if (this->_stopped)
+            {
+                break;
+            }
+            lock.unlock();
+            this->Compact();
+            lock.lock();
+        }
+    }
+
+    std::string                 _directory;
+    size_t                      _mask;
+    size_t                      _shard_bytes;   //单个分片的容量
+    size_t                      _segment_bytes;
+    double                      _compact_ratio;
+    std::chrono::milliseconds   _compact_interval;
+    std::atomic<bool>           _stopped;
+    std::unique_ptr<Shard[]>    _shards;
+    std::mutex                  _mutex;         //只用于整理线程的等待和退出
+    std::condition_variable     _condition;
+    std::thread                 _compactor;
+};
+}
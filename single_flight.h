@@ -0,0 +1,146 @@
+#pragma once
+#include <memory>
+#include <cstdint>
+#include <mutex>
+#include <future>
+#include <stdexcept>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include "cache_storage.h"
+#include "worker_pool.h"
+
+namespace cache
+{
+// 合并同一key的并发加载: 第一个调用方执行加载, 其余调用方等待同一个future
+// 加载抛出的异常会通过future传递给所有等待者; 异步加载在pool上执行, 默认为进程内共享的WorkerPool::Instance()
+template<class K, class V, class Hash = DefaultHash<K>, class KeyEqual = DefaultEqual<K>, class Holder = SharedValue>
+class SingleFlight
+{
+public:
+    using Result = typename Holder::template Result<V>;
+    using Future = std::shared_future<Result>;
+    using Load = std::function<Result()>;
+
+    explicit SingleFlight(WorkerPool &pool = WorkerPool::Instance())
+    :
+    _pool(&pool),
+    _pending(0)
+    {
+    }
+
+    //等待所有异步加载结束, 避免加载线程访问已析构的缓存
+    ~SingleFlight()
+    {
+        this->Wait();
+    }
+
+    //同步加载: 没有在途加载时在当前线程执行load
+    Future Do(const K &key, const Load &load)
+    {
+        std::promise<Result> promise;
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            auto itr = this->_calls.find(key);
+            if (itr != this->_calls.end())
+            {
+                return itr->second;
+            }
+            auto future = promise.get_future().share();
+            this->_calls.emplace(key, future);
+        }
+        return this->run(key, promise, load);
+    }
+
+    //异步加载: 没有在途加载时把load交给任务池, 调用方不阻塞, load不会在调用线程执行
+    //任务池队列已满时不登记这次加载, 返回的future携带std::runtime_error
+    Future DoAsync(const K &key, const Load &load)
+    {
+        auto promise = std::make_shared<std::promise<Result>>();
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        auto itr = this->_calls.find(key);
+        if (itr != this->_calls.end())
+        {
+            return itr->second;
+        }
+        //与TryDoAsync一样持有锁提交, 提交失败时其他调用方还没有看到这次加载
+        auto task = [this, key, promise, load]()
+        {
+            this->run(key, *promise, load);
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_pending--;
+            this->_condition.notify_all();
+        };
+        auto future = promise->get_future().share();
+        if (!this->_pool->Submit(task))
+        {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error("WorkerPool queue is full")));
+            return future;
+        }
+        this->_calls.emplace(key, future);
+        this->_pending++;
+        return future;
+    }
+
+    //尽力而为的异步加载, 不会在调用线程执行load: 已有在途加载时合并, 返回true
+    //在途的异步加载已达到max_pending或任务池队列已满时不加载, 返回false
+    bool TryDoAsync(const K &key, const Load &load, size_t max_pending = SIZE_MAX)
+    {
+        auto promise = std::make_shared<std::promise<Result>>();
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        if (this->_calls.find(key) != this->_calls.end())
+        {
+            return true;
+        }
+        if (this->_pending >= max_pending)
+        {
+            return false;
+        }
+        //持有锁提交, 提交失败时其他调用方还没有看到这次加载, 可以直接撤销
+        auto task = [this, key, promise, load]()
+        {
+            this->run(key, *promise, load);
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_pending--;
+            this->_condition.notify_all();
+        };
+        if (!this->_pool->Submit(task))
+        {
+            return false;
+        }
+        this->_calls.emplace(key, promise->get_future().share());
+        this->_pending++;
+        return true;
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_condition.wait(lock, [this]() { return this->_pending == 0; });
+    }
+
+private:
+    Future run(const K &key, std::promise<Result> &promise, const Load &load)
+    {
+        try
+        {
+            promise.set_value(load());
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        auto itr = this->_calls.find(key);
+        auto future = itr->second;
+        this->_calls.erase(itr);
+        return future;
+    }
+
+    WorkerPool                                          *_pool;
+    std::mutex                                          _mutex;
+    std::condition_variable                             _condition;
+    size_t                                              _pending;
+    std::unordered_map<K, Future, Hash, KeyEqual>       _calls;
+};
+}
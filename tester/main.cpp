@@ -15,9 +15,22 @@
 #include "phonedata.h"
 #include "local_cache.h"
 #include "expire_cache.h"
+#include "lru_cache.h"
+#include "clock_cache.h"
+#include "cache_snapshot.h"
+#include "segment_store.h"
+#include <malloc.h>
+#include <cmath>
+#include <random>
+#include <set>
+#include <fstream>
+#include <algorithm>
 #include "encoding.h"
 #include "ratelimit.h"
 
+//示例中顺带检查行为, 不满足时输出错误日志
+#define EXPECT(condition) do { if (!(condition)) { ERROR("expect failed: %s", #condition); } } while (0)
+
 void TestJsonSerialize()
 {
     test::Object t;
@@ -370,6 +383,432 @@ void TestExpireCache()
     }
 }
 
+void TestTimingWheel()
+{
+    //各层各放一个定时器, 推进时间不依赖真实时钟
+    using Clock = cache::TimingWheel<int64_t>::Clock;
+    auto base = Clock::now();
+    cache::TimingWheel<int64_t> wheel;
+    std::vector<int64_t> fired;
+    auto on_expire = [&](const int64_t &key)
+    {
+        fired.push_back(key);
+        return Clock::time_point::min();
+    };
+    wheel.Schedule(1, base + std::chrono::milliseconds(5));
+    wheel.Schedule(2, base + std::chrono::milliseconds(300));
+    wheel.Schedule(3, base + std::chrono::seconds(20));
+    wheel.Schedule(4, base + std::chrono::hours(2));
+    auto cancelled = wheel.Schedule(5, base + std::chrono::milliseconds(300));
+    wheel.Cancel(cancelled);
+    EXPECT(wheel.Size() == 4);
+
+    //到期前不触发, 到期后按时间顺序触发, 被取消的不触发
+    wheel.Advance(base + std::chrono::milliseconds(4), on_expire);
+    EXPECT(fired.empty());
+    wheel.Advance(base + std::chrono::milliseconds(400), on_expire);
+    EXPECT((fired == std::vector<int64_t>{1, 2}));
+    wheel.Advance(base + std::chrono::seconds(19), on_expire);
+    EXPECT(fired.size() == 2);
+    wheel.Advance(base + std::chrono::minutes(10), on_expire);
+    EXPECT((fired == std::vector<int64_t>{1, 2, 3}));
+    wheel.Advance(base + std::chrono::hours(3), on_expire);
+    EXPECT((fired == std::vector<int64_t>{1, 2, 3, 4}) && wheel.Empty());
+
+    //on_expire返回更晚的时间时按新时间重新放置
+    fired.clear();
+    auto now = base + std::chrono::hours(3);
+    wheel.Schedule(6, now + std::chrono::milliseconds(10));
+    bool extended = false;
+    auto count = wheel.Advance(now + std::chrono::milliseconds(20), [&](const int64_t &key)
+    {
+        fired.push_back(key);
+        if (!extended)
+        {
+            extended = true;
+            return now + std::chrono::milliseconds(1000);
+        }
+        return Clock::time_point::min();
+    });
+    EXPECT(count == 1 && wheel.Size() == 1);
+    wheel.Advance(now + std::chrono::milliseconds(1100), on_expire);
+    EXPECT(fired.size() == 2 && wheel.Empty());
+
+    //推进恰好停在256毫秒的降级边界: 第1层的定时器尚未降级, 下一次推进时间就是边界本身
+    fired.clear();
+    cache::TimingWheel<int64_t> boundary_wheel;
+    auto deadline = Clock::now() + std::chrono::milliseconds(300);
+    boundary_wheel.Schedule(7, deadline);
+    auto boundary = boundary_wheel.NextExpiration();
+    EXPECT(boundary < deadline);
+    boundary_wheel.Advance(boundary - std::chrono::milliseconds(1), on_expire);
+    EXPECT(fired.empty() && boundary_wheel.NextExpiration() == boundary);
+    boundary_wheel.Advance(boundary, on_expire);
+    auto next = boundary_wheel.NextExpiration();
+    EXPECT(fired.empty() && next > boundary && next <= deadline + std::chrono::milliseconds(1));
+    boundary_wheel.Advance(next, on_expire);
+    EXPECT((fired == std::vector<int64_t>{7}) && boundary_wheel.Empty());
+    INFO("timing wheel fired: %zu", fired.size());
+}
+
+void TestExpireCacheTtl()
+{
+    //默认不过期, 单个条目用ttl参数指定过期时间
+    cache::ExpireCache<int64_t, std::string> caches;
+    caches.Put(1, std::make_shared<std::string>("short"), std::chrono::milliseconds(50));
+    caches.Put(2, std::make_shared<std::string>("forever"));
+    //Put不覆盖已存在的值, Set覆盖并返回旧值
+    auto put = caches.Put(2, std::make_shared<std::string>("ignored"));
+    EXPECT(put.second && *put.first == "forever");
+    auto previous = caches.Set(3, std::make_shared<std::string>("v1"), std::chrono::milliseconds(50));
+    EXPECT(!previous);
+    previous = caches.Set(3, std::make_shared<std::string>("v2"), std::chrono::seconds(10));
+    EXPECT(previous && *previous == "v1" && *caches.Get(3) == "v2");
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    //Set同时刷新了过期时间
+    EXPECT(!caches.Get(1) && *caches.Get(2) == "forever" && *caches.Get(3) == "v2");
+
+    //滑动过期: 持续访问的条目不过期, 停止访问后按ttl过期
+    cache::ExpireCache<int64_t, std::string> sliding(nullptr, std::chrono::milliseconds(100));
+    sliding.EnableSliding();
+    sliding.Put(1, std::make_shared<std::string>("hot"));
+    sliding.Put(2, std::make_shared<std::string>("cold"));
+    for (int i = 0; i < 10; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        EXPECT(sliding.Get(1));
+    }
+    EXPECT(!sliding.Get(2));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT(!sliding.Get(1));
+    INFO("ttl entries left: %zu", caches.Count());
+}
+
+void TestExpireScheduler()
+{
+    //多个缓存共用一个清理线程, 每个缓存的条目都按时过期并通知
+    cache::ExpireScheduler scheduler(1);
+    std::atomic<int> expired(0);
+    std::atomic<int> manual(0);
+    auto on_delete = [&](const int64_t &key, const std::shared_ptr<int64_t> &value, bool is_manual)
+    {
+        (is_manual ? manual : expired)++;
+    };
+    std::vector<std::unique_ptr<cache::ExpireCache<int64_t, int64_t>>> caches;
+    for (int i = 0; i < 4; i++)
+    {
+        caches.emplace_back(new cache::ExpireCache<int64_t, int64_t>(on_delete, std::chrono::milliseconds(20 * (i + 1)), scheduler));
+        for (int64_t key = 0; key < 100; key++)
+        {
+            caches.back()->Put(key, std::make_shared<int64_t>(key));
+        }
+    }
+    //析构时注销清理任务, 之后不再回调
+    caches.pop_back();
+    for (int i = 0; i < 100 && expired < 300; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT(expired == 300 && manual == 0);
+    for (auto &cache : caches)
+    {
+        EXPECT(cache->Count() == 0);
+    }
+
+    //较早的到期时间会唤醒正在等待较晚时间的任务
+    std::atomic<int> runs(0);
+    auto start = std::chrono::steady_clock::now();
+    auto task = scheduler.Register([&](cache::ExpireScheduler::Clock::time_point now)
+    {
+        runs++;
+        return cache::ExpireScheduler::Clock::time_point::max();
+    }, start + std::chrono::hours(1));
+    scheduler.Wakeup(task, start + std::chrono::milliseconds(10));
+    for (int i = 0; i < 100 && runs == 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    scheduler.Unregister(task);
+    EXPECT(runs == 1);
+
+    //任务在执行中注销自己不会死锁, 之后不再执行
+    std::atomic<int> self_runs(0);
+    cache::ExpireScheduler::TaskId self_task = 0;
+    std::promise<void> registered;
+    auto registered_future = registered.get_future().share();
+    self_task = scheduler.Register([&, registered_future](cache::ExpireScheduler::Clock::time_point now)
+    {
+        registered_future.wait();
+        self_runs++;
+        scheduler.Unregister(self_task);
+        return now;
+    }, std::chrono::steady_clock::now());
+    registered.set_value();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT(self_runs == 1);
+
+    //慢的OnDelete不在清理线程上执行, 不会推迟其他缓存的过期清理
+    std::promise<void> release;
+    auto blocked = release.get_future().share();
+    std::atomic<int> slow_calls(0);
+    cache::ExpireCache<int64_t, int64_t> slow([&, blocked](const int64_t &key, const std::shared_ptr<int64_t> &value, bool is_manual)
+    {
+        slow_calls++;
+        blocked.wait();
+    }, std::chrono::milliseconds(10), scheduler);
+    cache::ExpireCache<int64_t, int64_t> fast(nullptr, std::chrono::milliseconds(50), scheduler);
+    slow.Put(1, std::make_shared<int64_t>(1));
+    fast.Put(1, std::make_shared<int64_t>(1));
+    for (int i = 0; i < 100 && fast.Count() != 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT(slow_calls == 1 && fast.Count() == 0);
+    release.set_value();
+
+    //可以在OnDelete中析构缓存
+    std::atomic<bool> destroyed(false);
+    std::promise<void> put;
+    auto put_future = put.get_future().share();
+    cache::ExpireCache<int64_t, int64_t> *owner = nullptr;
+    owner = new cache::ExpireCache<int64_t, int64_t>([&, put_future](const int64_t &key, const std::shared_ptr<int64_t> &value, bool is_manual)
+    {
+        put_future.wait();
+        if (!is_manual && !destroyed.exchange(true))
+        {
+            delete owner;
+        }
+    }, std::chrono::milliseconds(10), scheduler);
+    owner->Put(1, std::make_shared<int64_t>(1));
+    put.set_value();
+    for (int i = 0; i < 100 && !destroyed; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT(destroyed);
+    INFO("scheduler expired: %d, runs: %d", expired.load(), runs.load());
+}
+
+void TestExpireCacheCleanup()
+{
+    //同一高层槽位的大量定时器降级时也受limit限制, 分多次完成
+    using Clock = cache::TimingWheel<int64_t>::Clock;
+    auto base = Clock::now();
+    cache::TimingWheel<int64_t> wheel;
+    for (int64_t key = 0; key < 1000; key++)
+    {
+        wheel.Schedule(key, base + std::chrono::milliseconds(1000));
+    }
+    size_t fired = 0;
+    auto on_expire = [&](const int64_t &key)
+    {
+        fired++;
+        return Clock::time_point::min();
+    };
+    size_t calls = 0;
+    while (wheel.Advance(base + std::chrono::milliseconds(900), on_expire, 10) == 10)
+    {
+        calls++;
+    }
+    EXPECT(fired == 0 && calls >= 1000 / 10);
+    calls = 0;
+    while (wheel.Advance(base + std::chrono::milliseconds(1100), on_expire, 10) == 10)
+    {
+        calls++;
+    }
+    EXPECT(fired == 1000 && calls >= 1000 / 10 && wheel.Empty());
+
+    //读到已过期但尚未清理的条目按未命中处理, 写入时当作不存在
+    std::atomic<int> expired(0);
+    cache::ExpireCache<int64_t, int64_t> caches([&](const int64_t &key, const std::shared_ptr<int64_t> &value, bool is_manual)
+    {
+        if (!is_manual)
+        {
+            expired++;
+        }
+    }, std::chrono::milliseconds(20));
+    caches.EnableStats();
+    //每次持有写锁最多清理16个条目
+    caches.SetCleanupSlice(16, std::chrono::microseconds(1000000));
+    for (int64_t key = 0; key < 1000; key++)
+    {
+        caches.Put(key, std::make_shared<int64_t>(key));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT(!caches.Get(0) && !caches.Exists(1));
+    EXPECT(caches.Stats().misses == 1 && caches.Stats().hits == 0);
+    EXPECT(!caches.Put(2, std::make_shared<int64_t>(2), std::chrono::seconds(10)).second);
+    for (int i = 0; i < 100 && caches.Count() > 1; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    //写入key 2时清理的旧值也算作过期
+    EXPECT(caches.Count() == 1 && expired == 1000 && caches.Stats().expirations == 1000);
+    INFO("cleanup expired: %d", expired.load());
+}
+
+void TestExpireCacheBatch()
+{
+    //过期通知攒批后异步投递, 每批不超过batch_size; 手动删除仍同步调用OnDelete
+    std::atomic<int> on_delete(0);
+    std::mutex mutex;
+    std::vector<size_t> batches;
+    size_t delivered = 0;
+    cache::ExpireCache<int64_t, int64_t> caches([&](const int64_t &key, const std::shared_ptr<int64_t> &value, bool is_manual)
+    {
+        EXPECT(is_manual);
+        on_delete++;
+    }, std::chrono::milliseconds(10));
+    caches.EnableBatchExpire([&](const std::vector<std::pair<int64_t, std::shared_ptr<int64_t>>> &expired)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batches.push_back(expired.size());
+        delivered += expired.size();
+    }, 100, std::chrono::milliseconds(50));
+    for (int64_t key = 0; key < 251; key++)
+    {
+        caches.Put(key, std::make_shared<int64_t>(key));
+    }
+    caches.Delete(250);
+    EXPECT(on_delete == 1);
+    for (int i = 0; i < 100; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::lock_guard<std::mutex> lock(mutex);
+        if (delivered == 250)
+        {
+            break;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT(delivered == 250 && on_delete == 1);
+    EXPECT(batches.size() >= 3 && std::all_of(batches.begin(), batches.end(), [](size_t size) { return size > 0 && size <= 100; }));
+    EXPECT(caches.DroppedExpirations() == 0);
+
+    //回调跟不上时缓冲区不超过max_pending, 多出的通知被丢弃并计数
+    std::promise<void> release;
+    auto blocked = release.get_future().share();
+    std::atomic<size_t> bounded_delivered(0);
+    cache::ExpireCache<int64_t, int64_t> bounded(nullptr, std::chrono::milliseconds(10));
+    bounded.EnableBatchExpire([&, blocked](const std::vector<std::pair<int64_t, std::shared_ptr<int64_t>>> &expired)
+    {
+        blocked.wait();
+        bounded_delivered += expired.size();
+    }, 10, std::chrono::milliseconds(1), 1, 20);
+    for (int64_t key = 0; key < 100; key++)
+    {
+        bounded.Put(key, std::make_shared<int64_t>(key));
+    }
+    for (int i = 0; i < 100 && bounded.Count() != 0; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    release.set_value();
+    for (int i = 0; i < 100 && bounded_delivered + bounded.DroppedExpirations() < 100; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    //投递线程取走的一批不占缓冲区, 最多投递max_pending + batch_size条
+    EXPECT(bounded_delivered + bounded.DroppedExpirations() == 100 && bounded_delivered <= 30);
+    INFO("batch expire: %zu entries in %zu batches, dropped %zu of 100 when blocked", delivered, batches.size(), bounded.DroppedExpirations());
+}
+
+void TestExpireCacheCapacity()
+{
+    std::vector<int64_t> evicted;
+    auto on_delete = [&](const int64_t &key, const std::shared_ptr<std::string> &value, bool is_manual)
+    {
+        EXPECT(!is_manual);
+        evicted.push_back(key);
+    };
+    //近似LRU: 按写入顺序淘汰, 被访问过的条目跳过一次
+    cache::ExpireCache<int64_t, std::string> lru(on_delete);
+    lru.SetCapacity(3);
+    for (int64_t key = 1; key <= 3; key++)
+    {
+        lru.Put(key, std::make_shared<std::string>("v"));
+    }
+    lru.Get(1);
+    lru.Put(4, std::make_shared<std::string>("v"));
+    EXPECT((evicted == std::vector<int64_t>{2}) && lru.Count() == 3 && lru.Exists(1));
+
+    //优先淘汰最早过期的条目
+    evicted.clear();
+    cache::ExpireCache<int64_t, std::string> soonest(on_delete);
+    soonest.SetCapacity(3, SIZE_MAX, nullptr, cache::EvictPolicy::SoonestExpiring);
+    soonest.Put(1, std::make_shared<std::string>("v"), std::chrono::seconds(10));
+    soonest.Put(2, std::make_shared<std::string>("v"), std::chrono::seconds(1));
+    soonest.Put(3, std::make_shared<std::string>("v"), std::chrono::seconds(5));
+    soonest.Get(2);
+    soonest.Put(4, std::make_shared<std::string>("v"), std::chrono::seconds(20));
+    EXPECT((evicted == std::vector<int64_t>{2}) && soonest.Count() == 3);
+
+    //按总开销淘汰
+    evicted.clear();
+    cache::ExpireCache<int64_t, std::string> bytes(on_delete);
+    bytes.SetCapacity(SIZE_MAX, 100, [](const int64_t &key, const std::shared_ptr<std::string> &value)
+    {
+        return value->size();
+    });
+    bytes.Put(1, std::make_shared<std::string>(60, 'a'));
+    bytes.Put(2, std::make_shared<std::string>(30, 'b'));
+    EXPECT(evicted.empty());
+    bytes.Put(3, std::make_shared<std::string>(50, 'c'));
+    EXPECT((evicted == std::vector<int64_t>{1}) && bytes.Count() == 2);
+    INFO("capacity evicted: %zu", evicted.size());
+}
+
+void TestExpireCacheRefresh()
+{
+    //剩余有效期不足一半时后台刷新, 刷新完成前返回旧值, 完成后过期时间重新计算
+    std::atomic<int> loads(0);
+    cache::ExpireCache<int64_t, std::string> caches(nullptr, std::chrono::milliseconds(300));
+    caches.EnableRefreshAhead([&](const int64_t &key)
+    {
+        loads++;
+        return std::make_shared<std::string>("new");
+    }, 0.5);
+    caches.Put(1, std::make_shared<std::string>("old"));
+    EXPECT(*caches.Get(1) == "old" && loads == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT(*caches.Get(1) == "old");
+    for (int i = 0; i < 100 && *caches.Get(1) != "new"; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT(loads == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(140));
+    EXPECT(caches.Get(1));
+
+    //在途刷新达到上限时跳过, Get不等待也不在读线程上加载
+    std::atomic<int> running(0);
+    std::atomic<bool> release(false);
+    cache::ExpireCache<int64_t, std::string> limited(nullptr, std::chrono::milliseconds(100));
+    limited.EnableRefreshAhead([&](const int64_t &key)
+    {
+        running++;
+        while (!release)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return std::make_shared<std::string>("new");
+    }, 1.0, 2);
+    for (int64_t key = 0; key < 10; key++)
+    {
+        limited.Put(key, std::make_shared<std::string>("old"));
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t key = 0; key < 10; key++)
+    {
+        EXPECT(*limited.Get(key) == "old");
+    }
+    auto cost = std::chrono::steady_clock::now() - start;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT(running <= 2 && cost < std::chrono::milliseconds(20));
+    release = true;
+    INFO("refresh loads: %d, limited running: %d", loads.load(), running.load());
+}
+
 void TestLocalCache()
 {
     cache::LocalCache<int64_t, test::SubObject> caches;
@@ -385,6 +824,802 @@ void TestLocalCache()
     INFO("是否存在: %d, value: %s", itr.second, serialize::JsonSerializer<test::SubObject>::ToString(itr.first).data());
 }
 
+void TestShardedLocalCache()
+{
+    //分片数向上取整为2的幂, key分散到各个分片
+    cache::ShardedLocalCache<int64_t, std::string> caches(10);
+    EXPECT(caches.ShardCount() == 16);
+    for (int64_t i = 0; i < 1000; i++)
+    {
+        caches.Put(i, std::make_shared<std::string>(std::to_string(i)));
+    }
+    EXPECT(caches.Count() == 1000);
+    size_t used = 0;
+    for (size_t i = 0; i < caches.ShardCount(); i++)
+    {
+        used += caches.GetShard(i).Count() > 0 ? 1 : 0;
+    }
+    EXPECT(used == caches.ShardCount());
+
+    //Put不覆盖已有值, 返回已有值和true
+    auto value = caches.Get(500);
+    EXPECT(value && *value == "500");
+    auto result = caches.Put(500, std::make_shared<std::string>("new"));
+    EXPECT(result.second && *result.first == "500");
+    EXPECT(caches.Delete(500) && !caches.Exists(500) && caches.Count() == 999);
+
+    //多线程写入不同的key, 不丢失
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++)
+    {
+        workers.emplace_back([&, t]()
+        {
+            for (int64_t i = 0; i < 10000; i++)
+            {
+                caches.Put(100000 * (t + 1) + i, std::make_shared<std::string>("v"));
+            }
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    EXPECT(caches.Count() == 999 + 40000);
+    caches.Clear();
+    EXPECT(caches.Count() == 0);
+    INFO("sharded local cache: shards: %zu", caches.ShardCount());
+}
+
+void TestLocalCacheScan()
+{
+    cache::LocalCache<int64_t, std::string> caches;
+    for (int64_t i = 0; i < 1000; i++)
+    {
+        caches.Put(i, std::make_shared<std::string>(std::to_string(i)));
+    }
+    //分块遍历, 中途写入大量条目触发rehash, 全程存在的条目仍要全部回调到(可能重复)
+    std::vector<int> seen(1000, 0);
+    size_t callbacks = 0;
+    caches.Scan([&](const int64_t &key, const std::shared_ptr<std::string> &)
+    {
+        if (callbacks++ == 100)
+        {
+            for (int64_t i = 1000; i < 20000; i++)
+            {
+                caches.Put(i, std::make_shared<std::string>("new"));
+            }
+        }
+        if (key < 1000)
+        {
+            seen[key]++;
+        }
+        return true;
+    }, 32);
+    EXPECT(std::count(seen.begin(), seen.end(), 0) == 0);
+
+    //回调中持续写入使缓存不断增长, 遍历最多重来一次, 每个条目最多回调两次
+    std::fill(seen.begin(), seen.end(), 0);
+    int64_t next = 100000;
+    caches.Scan([&](const int64_t &key, const std::shared_ptr<std::string> &)
+    {
+        for (int i = 0; i < 20; i++)
+        {
+            caches.Put(next++, std::make_shared<std::string>("grow"));
+        }
+        if (key < 1000)
+        {
+            seen[key]++;
+        }
+        return true;
+    }, 32);
+    EXPECT(std::count(seen.begin(), seen.end(), 0) == 0 && *std::max_element(seen.begin(), seen.end()) <= 2);
+
+    //回调返回false时立即停止
+    size_t visited = 0;
+    caches.Scan([&](const int64_t &, const std::shared_ptr<std::string> &)
+    {
+        return ++visited < 10;
+    }, 32);
+    EXPECT(visited == 10);
+    INFO("scan callbacks: %zu, entries after rehash: %zu", callbacks, caches.Count());
+}
+
+void TestLocalCacheBatch()
+{
+    cache::ShardedLocalCache<std::string, std::string> caches;
+    std::vector<cache::ShardedLocalCache<std::string, std::string>::Item> items;
+    for (int i = 0; i < 100; i++)
+    {
+        items.emplace_back("key" + std::to_string(i), std::make_shared<std::string>(std::to_string(i)));
+    }
+    auto puts = caches.MultiPut(items);
+    EXPECT(puts.size() == 100 && !puts[0].second && caches.Count() == 100);
+    //已存在的key不覆盖, 与Put一致
+    items.resize(1);
+    items[0].second = std::make_shared<std::string>("new");
+    puts = caches.MultiPut(items);
+    EXPECT(puts[0].second && *puts[0].first == "0");
+
+    //结果与keys顺序一致, 未命中为空
+    std::vector<std::string> keys = {"key42", "missing", "key7", "key99"};
+    auto results = caches.MultiGet(keys);
+    EXPECT(results.size() == 4 && *results[0] == "42" && !results[1] && *results[2] == "7" && *results[3] == "99");
+    INFO("multi get: %zu keys, %d hits", keys.size(), static_cast<int>(std::count_if(results.begin(), results.end(), [](const std::shared_ptr<std::string> &value) { return value != nullptr; })));
+}
+
+void TestCacheStats()
+{
+    //默认关闭, 不计数
+    cache::LocalCache<int64_t, int64_t> caches;
+    caches.Put(1, std::make_shared<int64_t>(1));
+    caches.Get(1);
+    EXPECT(caches.Stats().puts == 0 && caches.Stats().hits == 0 && caches.Stats().lock_waits == 0);
+    //未开启时不分配计数单元
+    EXPECT(sizeof(cache::CacheStatsRecorder) <= 2 * sizeof(void *));
+
+    caches.EnableStats();
+    caches.Put(2, std::make_shared<int64_t>(2));
+    caches.Get(1);
+    caches.Get(2);
+    caches.Get(3);
+    caches.MultiGet(std::vector<int64_t>{1, 4, 5});
+    auto stats = caches.Stats();
+    EXPECT(stats.puts == 1 && stats.hits == 3 && stats.misses == 3);
+    EXPECT(stats.HitRatio() == 0.5);
+    //每次加锁都记入直方图, 单线程下全部落在无竞争桶
+    EXPECT(stats.lock_waits >= 5 && stats.lock_waits == stats.lock_wait_histogram[0]);
+    //关闭后保留已有计数, 重新开启继续累加
+    caches.EnableStats(false);
+    caches.Get(1);
+    EXPECT(caches.Stats().hits == 3);
+    caches.EnableStats();
+    caches.Get(1);
+    EXPECT(caches.Stats().hits == 4);
+
+    //分片缓存汇总所有分片
+    cache::ShardedLocalCache<int64_t, int64_t> sharded;
+    sharded.EnableStats();
+    for (int64_t i = 0; i < 100; i++)
+    {
+        sharded.Put(i, std::make_shared<int64_t>(i));
+    }
+    for (int64_t i = 0; i < 200; i++)
+    {
+        sharded.Get(i);
+    }
+    stats = sharded.Stats();
+    EXPECT(stats.puts == 100 && stats.hits == 100 && stats.misses == 100);
+
+    cache::LRUCache<int64_t, std::shared_ptr<int64_t>> lru(10);
+    lru.enable_stats();
+    auto value = std::make_shared<int64_t>(1);
+    for (int64_t i = 0; i < 15; i++)
+    {
+        lru.put(i, value);
+    }
+    lru.get(0);
+    lru.get(14);
+    stats = lru.stats();
+    EXPECT(stats.puts == 15 && stats.evictions == 5 && stats.hits == 1 && stats.misses == 1);
+    INFO("stats: puts %llu, hits %llu, misses %llu, evictions %llu", 
+         static_cast<unsigned long long>(stats.puts), static_cast<unsigned long long>(stats.hits),
+         static_cast<unsigned long long>(stats.misses), static_cast<unsigned long long>(stats.evictions));
+}
+
+void TestCacheLoad()
+{
+    //同一key的并发未命中只调用一次loader
+    cache::LocalCache<int64_t, std::string> caches;
+    caches.EnableStats();
+    std::atomic<int> loads(0);
+    auto loader = [&](const int64_t &key)
+    {
+        loads++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return std::make_shared<std::string>(std::to_string(key));
+    };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 8; t++)
+    {
+        workers.emplace_back([&]()
+        {
+            auto value = caches.GetOrLoad(1, loader);
+            EXPECT(value && *value == "1");
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    EXPECT(loads == 1);
+
+    //一次未命中的加载只计一次miss
+    auto before = caches.Stats().misses;
+    caches.GetOrLoad(2, loader);
+    EXPECT(caches.Stats().misses == before + 1);
+
+    //大量key同时异步加载, 加载线程数受任务池限制
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::vector<std::shared_future<std::shared_ptr<std::string>>> futures;
+    for (int64_t i = 100; i < 300; i++)
+    {
+        futures.push_back(caches.GetOrLoadAsync(i, [&](const int64_t &key)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            threads.insert(std::this_thread::get_id());
+            return std::make_shared<std::string>(std::to_string(key));
+        }));
+    }
+    for (auto &future : futures)
+    {
+        future.get();
+    }
+    EXPECT(caches.Count() == 202);
+    EXPECT(threads.size() <= cache::WorkerPool::DefaultThreads);
+    INFO("single flight loads: %d, async load threads: %zu", loads.load(), threads.size());
+
+    //任务池队列已满时不在调用线程加载, future携带异常且不登记在途加载
+    std::promise<void> release;
+    auto blocked = release.get_future().share();
+    cache::WorkerPool pool(1, 1);
+    cache::SingleFlight<int64_t, std::string> flight(pool);
+    auto slow = [blocked]() { blocked.wait(); return std::make_shared<std::string>("slow"); };
+    auto first = flight.DoAsync(1, slow);
+    while (!pool.Submit([blocked]() { blocked.wait(); }))
+    {
+        std::this_thread::yield();
+    }
+    auto caller = std::this_thread::get_id();
+    auto inline_run = false;
+    auto rejected = flight.DoAsync(2, [&]()
+    {
+        inline_run = std::this_thread::get_id() == caller;
+        return std::make_shared<std::string>("rejected");
+    });
+    EXPECT(rejected.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    auto failed = false;
+    try
+    {
+        rejected.get();
+    }
+    catch (const std::runtime_error &)
+    {
+        failed = true;
+    }
+    EXPECT(failed && !inline_run);
+    release.set_value();
+    EXPECT(*first.get() == "slow");
+    EXPECT(*flight.Do(2, []() { return std::make_shared<std::string>("sync"); }).get() == "sync");
+}
+
+template<class Storage>
+void BenchCacheStorage(const char *name, int64_t count)
+{
+    //所有条目共享同一个value, 内存差异只来自哈希表本身
+    auto value = std::make_shared<test::SubObject>();
+    auto info = mallinfo2();
+    auto before = info.uordblks + info.hblkhd;
+    cache::LocalCache<int64_t, test::SubObject, Storage> caches;
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < count; i++)
+    {
+        caches.Put(i * 7919, value);
+    }
+    auto put_cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    info = mallinfo2();
+    auto memory = info.uordblks + info.hblkhd - before;
+
+    int64_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < count; i++)
+    {
+        //乱序查找, 一半命中一半未命中
+        auto key = (i * 2654435761LL) % count * 7919 + (i & 1);
+        if (caches.Get(key))
+        {
+            hits++;
+        }
+    }
+    auto get_cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    INFO("[%s] count: %lld, put: %.1fns/op, get: %.1fns/op, hits: %lld, memory: %.1fMB",
+         name, count, put_cost / count, get_cost / count, hits, memory / 1024.0 / 1024.0);
+}
+
+void TestCacheStorage()
+{
+    for (int64_t count : {100000, 1000000, 5000000})
+    {
+        BenchCacheStorage<cache::NodeStorage>("unordered_map", count);
+        BenchCacheStorage<cache::FlatStorage>("flat_hash_map", count);
+    }
+}
+
+//16字节路由条目, 多线程反复查找同一批热点key
+struct RouteEntry
+{
+    int64_t gateway;
+    int32_t weight;
+    int32_t flags;
+};
+
+template<class Holder>
+void BenchCacheHolder(const char *name, int threads)
+{
+    const int64_t hot_keys = 16;
+    const int64_t loops = 2000000;
+    cache::ShardedLocalCache<int64_t, RouteEntry, cache::FlatStorage, Holder> caches;
+    for (int64_t i = 0; i < hot_keys; i++)
+    {
+        if constexpr (std::is_same<Holder, cache::InlineValue>::value)
+        {
+            caches.Put(i, RouteEntry{i, 1, 0});
+        }
+        else
+        {
+            caches.Put(i, std::make_shared<RouteEntry>(RouteEntry{i, 1, 0}));
+        }
+    }
+    std::atomic<int64_t> sum(0);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&]()
+        {
+            int64_t local = 0;
+            for (int64_t i = 0; i < loops; i++)
+            {
+                local += caches.Get(i % hot_keys)->gateway;
+            }
+            sum += local;
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    auto cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    INFO("[%s] threads: %d, get: %.1fns/op, sum: %lld", name, threads, cost / loops, sum.load());
+}
+
+void TestCacheHolder()
+{
+    for (int threads : {1, 4, 16})
+    {
+        BenchCacheHolder<cache::SharedValue>("shared_ptr", threads);
+        BenchCacheHolder<cache::InlineValue>("inline", threads);
+    }
+}
+
+void BenchLRUCache(size_t capacity)
+{
+    auto value = std::make_shared<RouteEntry>(RouteEntry{1, 1, 0});
+    cache::LRUCache<int64_t, std::shared_ptr<RouteEntry>> caches(capacity);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        caches.put(i, value);
+    }
+    //key空间为容量的2倍, 命中时提升, 未命中时写入并淘汰
+    const int64_t loops = 2000000;
+    int64_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < loops; i++)
+    {
+        auto key = static_cast<int64_t>((i * 2654435761LL) % (capacity * 2));
+        if (caches.get(key))
+        {
+            hits++;
+        }
+        else
+        {
+            caches.put(key, value);
+        }
+    }
+    auto cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    INFO("[lru] capacity: %zu, get/put: %.1fns/op, hits: %lld", capacity, cost / loops, hits);
+}
+
+void TestLRUCache()
+{
+    for (size_t capacity : {10000, 100000, 1000000})
+    {
+        BenchLRUCache(capacity);
+    }
+}
+
+void TestLRUCacheWeight()
+{
+    size_t deleted = 0;
+    cache::LRUCache<int64_t, std::shared_ptr<std::string>> caches(1000, [&](const int64_t &key, std::shared_ptr<std::string> value)
+    {
+        deleted++;
+    });
+    caches.set_max_weight(1000, [](const int64_t &key, const std::shared_ptr<std::string> &value)
+    {
+        return value->size();
+    });
+    for (int64_t key = 0; key < 100; key++)
+    {
+        caches.put(key, std::make_shared<std::string>(5, 'v'));
+    }
+    EXPECT(caches.size() == 100 && caches.weight() == 500 && deleted == 0);
+    //单个条目超过max_weight时只淘汰它自己
+    caches.put(100, std::make_shared<std::string>(2000, 'v'));
+    EXPECT(caches.size() == 100 && caches.weight() == 500 && deleted == 1 && !caches.get(100));
+    //覆盖成超重的值时同样只淘汰这个key
+    caches.put(0, std::make_shared<std::string>(2000, 'v'));
+    EXPECT(caches.size() == 99 && caches.weight() == 495 && deleted == 2 && !caches.get(0));
+    //总权重超出时仍按LRU淘汰最旧的条目
+    caches.put(101, std::make_shared<std::string>(600, 'v'));
+    EXPECT(caches.weight() <= 1000 && !caches.get(1) && caches.get(99) && caches.get(101));
+    //调小max_weight时超重的条目单独淘汰
+    caches.set_max_weight(500, [](const int64_t &key, const std::shared_ptr<std::string> &value)
+    {
+        return value->size();
+    });
+    EXPECT(!caches.get(101) && caches.get(99) && caches.weight() <= 500);
+    INFO("weight: %zu, size: %zu, deleted: %zu", caches.weight(), caches.size(), deleted);
+}
+
+template<class Cache>
+void BenchLRUConcurrency(const char *name, int threads)
+{
+    const size_t capacity = 100000;
+    const int64_t loops = 1000000;
+    auto value = std::make_shared<RouteEntry>(RouteEntry{1, 1, 0});
+    Cache caches(capacity);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        caches.put(i, value);
+    }
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+        {
+            for (int64_t i = 0; i < loops; i++)
+            {
+                auto key = static_cast<int64_t>((i * 2654435761LL + t) % (capacity * 2));
+                if (!caches.get(key))
+                {
+                    caches.put(key, value);
+                }
+            }
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    INFO("[%s] threads: %d, throughput: %.2fM ops/s", name, threads, threads * loops / cost / 1000000);
+}
+
+void TestShardedLRUCache()
+{
+    for (int threads : {1, 4, 16, 32})
+    {
+        BenchLRUConcurrency<cache::LRUCache<int64_t, std::shared_ptr<RouteEntry>>>("lru", threads);
+        BenchLRUConcurrency<cache::ShardedLRUCache<int64_t, std::shared_ptr<RouteEntry>>>("sharded_lru", threads);
+        BenchLRUConcurrency<cache::ClockCache<int64_t, std::shared_ptr<RouteEntry>>>("clock", threads);
+        BenchLRUConcurrency<cache::LRUCache<int64_t, std::shared_ptr<RouteEntry>, cache::DefaultHash<int64_t>, cache::DefaultEqual<int64_t>,
+                                            cache::NodeStorage, cache::NoAdmission, cache::BufferedPromotion>>("buffered_lru", threads);
+    }
+}
+
+void TestReadBuffer()
+{
+    //条带写满后只有第一个写入方取得排空资格, 其余记录直接丢弃
+    cache::ReadBuffer<int64_t> buffer;
+    size_t drains = 0;
+    for (int64_t i = 0; i < 100; i++)
+    {
+        drains += buffer.Offer(i) ? 1 : 0;
+    }
+    EXPECT(drains == 1);
+    //没能排空时归还资格, 下一个写入方可以再次尝试
+    buffer.ReleaseDrain();
+    EXPECT(buffer.Offer(100) && !buffer.Offer(101));
+    std::vector<int64_t> drained;
+    buffer.Drain([&](const int64_t &key)
+    {
+        drained.push_back(key);
+    });
+    EXPECT(drained.size() == cache::ReadBuffer<int64_t>::StripeSize && drained.front() == 0);
+    //排空后资格自动归还
+    drains = 0;
+    for (int64_t i = 0; i < 100; i++)
+    {
+        drains += buffer.Offer(i) ? 1 : 0;
+    }
+    EXPECT(drains == 1);
+
+    //缓冲提升的LRU: 读缓冲只记节点, 下一次写入时补做提升; 删除前先排空, 不会提升已删除的节点
+    using BufferedLRU = cache::LRUCache<std::string, std::shared_ptr<int64_t>, cache::DefaultHash<std::string>, cache::DefaultEqual<std::string>,
+                                        cache::NodeStorage, cache::NoAdmission, cache::BufferedPromotion>;
+    BufferedLRU lru(4);
+    auto value = std::make_shared<int64_t>(1);
+    for (auto key : {"a", "b", "c", "d"})
+    {
+        lru.put(key, value);
+    }
+    lru.get(std::string("a"));
+    lru.put("e", value);
+    EXPECT(lru.contains(std::string("a")) && !lru.contains(std::string("b")));
+    lru.get(std::string("c"));
+    EXPECT(lru.remove(std::string("c")));
+    lru.put("f", value);
+    lru.put("g", value);
+    EXPECT(lru.size() == 4 && !lru.contains(std::string("c")));
+    INFO("read buffer drained: %zu", drained.size());
+}
+
+void TestClockCache()
+{
+    std::vector<int64_t> deleted;
+    cache::ClockCache<int64_t, std::shared_ptr<RouteEntry>> caches(4, [&](const int64_t &key, std::shared_ptr<RouteEntry> value)
+    {
+        deleted.push_back(key);
+    });
+    auto value = std::make_shared<RouteEntry>(RouteEntry{1, 1, 0});
+    for (int64_t key = 1; key <= 4; key++)
+    {
+        caches.put(key, value);
+    }
+    //被访问过的条目获得第二次机会, 指针清除标记后跳过; mark_used为false时不置位
+    caches.get(1);
+    caches.get(3);
+    caches.get(4, false);
+    caches.put(5, value);
+    caches.put(6, value);
+    EXPECT((deleted == std::vector<int64_t>{2, 4}));
+    //第二次机会只有一次, 标记已被清除的条目下一轮被淘汰
+    caches.put(7, value);
+    EXPECT((deleted == std::vector<int64_t>{2, 4, 1}) && caches.contains(3) && caches.size() == 4);
+
+    //移除和清空都回调deleter, 析构时不再重复回调
+    deleted.clear();
+    EXPECT(caches.remove(5) && !caches.remove(5));
+    EXPECT((deleted == std::vector<int64_t>{5}) && caches.size() == 3);
+    caches.clear();
+    std::sort(deleted.begin(), deleted.end());
+    EXPECT((deleted == std::vector<int64_t>{3, 5, 6, 7}) && caches.size() == 0 && !caches.get(3));
+    caches.put(8, value);
+    EXPECT(caches.get(8) == value);
+    INFO("clock deleted: %zu", deleted.size());
+}
+
+template<class Cache>
+double ReplayTrace(const std::vector<int64_t> &trace, size_t capacity)
+{
+    auto value = std::make_shared<RouteEntry>(RouteEntry{1, 1, 0});
+    Cache caches(capacity);
+    int64_t hits = 0;
+    for (auto key : trace)
+    {
+        if (caches.get(key))
+        {
+            hits++;
+        }
+        else
+        {
+            caches.put(key, value);
+        }
+    }
+    return trace.empty() ? 0 : static_cast<double>(hits) / trace.size();
+}
+
+//模拟营销群发: Zipf分布的热点访问中穿插只访问一次的号码扫描
+std::vector<int64_t> CampaignTrace()
+{
+    const size_t keys = 100000;
+    std::vector<double> cdf(keys);
+    double sum = 0;
+    for (size_t i = 0; i < keys; i++)
+    {
+        sum += 1.0 / std::pow(i + 1, 0.9);
+        cdf[i] = sum;
+    }
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<int64_t> trace;
+    int64_t scan = 13800000000LL;
+    for (int round = 0; round < 40; round++)
+    {
+        for (int i = 0; i < 50000; i++)
+        {
+            trace.push_back(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+        }
+        if (round % 2 == 1)
+        {
+            for (int i = 0; i < 30000; i++)
+            {
+                trace.push_back(scan++);
+            }
+        }
+    }
+    return trace;
+}
+
+//trace_path为每行一个key的访问记录, 为空时使用模拟的群发访问
+void TestLRUAdmission(const char *trace_path = nullptr)
+{
+    std::vector<int64_t> trace;
+    if (trace_path)
+    {
+        std::ifstream file(trace_path);
+        int64_t key;
+        while (file >> key)
+        {
+            trace.push_back(key);
+        }
+    }
+    else
+    {
+        trace = CampaignTrace();
+    }
+    using Lru = cache::LRUCache<int64_t, std::shared_ptr<RouteEntry>>;
+    using TinyLfu = cache::LRUCache<int64_t, std::shared_ptr<RouteEntry>, cache::DefaultHash<int64_t>, cache::DefaultEqual<int64_t>, cache::NodeStorage, cache::TinyLFUAdmission>;
+    for (size_t capacity : {1000, 10000, 50000})
+    {
+        INFO("capacity: %zu, accesses: %zu, lru hit ratio: %.4f, w-tinylfu hit ratio: %.4f",
+             capacity, trace.size(), ReplayTrace<Lru>(trace, capacity), ReplayTrace<TinyLfu>(trace, capacity));
+    }
+}
+
+//渲染后的拨号方案文档: 内存只放得下20%的文档, 其余溢出到磁盘二级缓存, 未命中的才需要重新渲染
+template<class Cache>
+void BenchTieredLRU(const char *name, Cache &caches, const std::vector<int64_t> &trace)
+{
+    int64_t misses = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto key : trace)
+    {
+        auto document = "dialplan:" + std::to_string(key);
+        if (!caches.get(document))
+        {
+            misses++;
+            caches.put(document, std::make_shared<std::string>(std::string(2048 + key % 1024, 'a' + key % 26)));
+        }
+    }
+    auto cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    INFO("[%s] accesses: %zu, hit ratio: %.4f, %.1fns/op", name, trace.size(), 1 - static_cast<double>(misses) / trace.size(), cost / trace.size());
+}
+
+void TestTieredLRUCache()
+{
+    const size_t documents = 50000;
+    std::vector<double> cdf(documents);
+    double sum = 0;
+    for (size_t i = 0; i < documents; i++)
+    {
+        sum += 1.0 / std::pow(i + 1, 0.8);
+        cdf[i] = sum;
+    }
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<int64_t> trace;
+    for (int i = 0; i < 1000000; i++)
+    {
+        trace.push_back(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+    }
+
+    using Store = cache::SegmentStore<std::string, std::string>;
+    using Memory = cache::LRUCache<std::string, std::shared_ptr<std::string>>;
+    using Tiered = cache::LRUCache<std::string, std::shared_ptr<std::string>, cache::DefaultHash<std::string>, cache::DefaultEqual<std::string>,
+                                   cache::NodeStorage, cache::NoAdmission, cache::ExactPromotion, Store>;
+    Memory memory(documents / 5);
+    BenchTieredLRU("memory", memory, trace);
+
+    auto store = std::make_shared<Store>("dialplan.l2", 512 << 20, 16 << 20);
+    Tiered tiered(documents / 5);
+    tiered.set_second_level(store);
+    BenchTieredLRU("memory+disk", tiered, trace);
+    INFO("l2 count: %zu, l2 bytes: %zu", store->Count(), store->Bytes());
+}
+
+void TestSecondLevelOwnership()
+{
+    using Store = cache::SegmentStore<std::string, std::string>;
+    using Tiered = cache::LRUCache<std::string, std::shared_ptr<std::string>, cache::DefaultHash<std::string>, cache::DefaultEqual<std::string>,
+                                   cache::NodeStorage, cache::NoAdmission, cache::ExactPromotion, Store>;
+    auto store = std::make_shared<Store>("shared.l2", 64 << 20);
+    Tiered first(10);
+    first.set_second_level(store, false);
+    {
+        //共用的二级缓存在其他缓存析构或清空时保留
+        Tiered second(10);
+        second.set_second_level(store, false);
+        for (int i = 0; i < 20; i++)
+        {
+            first.put("first" + std::to_string(i), std::make_shared<std::string>("v"));
+            second.put("second" + std::to_string(i), std::make_shared<std::string>("v"));
+        }
+        EXPECT(store->Count() == 20);
+    }
+    EXPECT(store->Count() == 20);
+    first.clear();
+    EXPECT(store->Count() == 20 && first.get("first0"));
+    //独占时随缓存一起清空
+    Tiered owner(10);
+    owner.set_second_level(store);
+    owner.clear();
+    EXPECT(store->Count() == 0);
+    INFO("shared second level kept until owner clear");
+}
+
+void TestCacheSnapshot()
+{
+    cache::ShardedLocalCache<int64_t, test::SubObject> caches;
+    for (int64_t i = 0; i < 1000000; i++)
+    {
+        auto sub = std::make_shared<test::SubObject>();
+        sub->Int32 = i;
+        sub->String = std::to_string(i);
+        caches.Put(i, sub);
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto ok = cache::CacheSnapshot<int64_t, test::SubObject>::Save(caches, "cache.snapshot");
+    auto save_cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    INFO("save: %d, count: %lld, cost: %lldms", ok, caches.Count(), save_cost);
+
+    cache::ShardedLocalCache<int64_t, test::SubObject> restored;
+    start = std::chrono::steady_clock::now();
+    ok = cache::CacheSnapshot<int64_t, test::SubObject>::Load(restored, "cache.snapshot");
+    auto load_cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    auto sub = restored.Get(999999);
+    INFO("load: %d, count: %lld, cost: %lldms, value: %s", ok, restored.Count(), load_cost,
+         serialize::JsonSerializer<test::SubObject>::ToString(sub).data());
+}
+
+void TestCacheSnapshotCorrupt()
+{
+    cache::LocalCache<int64_t, int64_t> caches;
+    caches.Put(1, std::make_shared<int64_t>(100));
+    EXPECT((cache::CacheSnapshot<int64_t, int64_t>::Save(caches, "corrupt.snapshot")));
+    cache::LocalCache<int64_t, int64_t> restored;
+    EXPECT((cache::CacheSnapshot<int64_t, int64_t>::Load(restored, "corrupt.snapshot")) && *restored.Get(1) == 100);
+
+    //把唯一一条记录的value截断为4字节, 段长度同步修改, 分帧仍然完整, 只有长度与int64_t不符
+    std::fstream file("corrupt.snapshot", std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t segment_length = 20;
+    uint32_t value_length = 4;
+    file.seekp(16 + 8);
+    file.write(reinterpret_cast<const char *>(&segment_length), sizeof(segment_length));
+    file.seekp(16 + 24 + 4 + 8);
+    file.write(reinterpret_cast<const char *>(&value_length), sizeof(value_length));
+    file.close();
+    cache::LocalCache<int64_t, int64_t> corrupted;
+    EXPECT(!(cache::CacheSnapshot<int64_t, int64_t>::Load(corrupted, "corrupt.snapshot")));
+    EXPECT(corrupted.Count() == 0);
+
+    //第一条记录完好, 第二条记录损坏: 整个快照被拒绝, 第一条也不写入缓存
+    caches.Put(2, std::make_shared<int64_t>(200));
+    EXPECT((cache::CacheSnapshot<int64_t, int64_t>::Save(caches, "corrupt.snapshot")));
+    file.open("corrupt.snapshot", std::ios::in | std::ios::out | std::ios::binary);
+    segment_length = 44;
+    file.seekp(16 + 8);
+    file.write(reinterpret_cast<const char *>(&segment_length), sizeof(segment_length));
+    file.seekp(16 + 24 + 24 + 4 + 8);
+    file.write(reinterpret_cast<const char *>(&value_length), sizeof(value_length));
+    file.close();
+    EXPECT(!(cache::CacheSnapshot<int64_t, int64_t>::Load(corrupted, "corrupt.snapshot")));
+    EXPECT(corrupted.Count() == 0);
+
+    //段数超出文件长度
+    EXPECT((cache::CacheSnapshot<int64_t, int64_t>::Save(caches, "corrupt.snapshot")));
+    file.open("corrupt.snapshot", std::ios::in | std::ios::out | std::ios::binary);
+    uint32_t segment_count = 1000000;
+    file.seekp(12);
+    file.write(reinterpret_cast<const char *>(&segment_count), sizeof(segment_count));
+    file.close();
+    EXPECT(!(cache::CacheSnapshot<int64_t, int64_t>::Load(corrupted, "corrupt.snapshot")));
+    EXPECT(corrupted.Count() == 0);
+    INFO("corrupt snapshot rejected: %d", corrupted.Count() == 0);
+}
+
 void TestEncoding()
 {
     std::string utf8_data = "【短信测试】 我是普通短信，编码GBK, 没有表情图 end";
@@ -681,7 +1916,31 @@ int main()
     //TestTrie();
     //TestEncoding();
     //TestLocalCache();
+    //TestShardedLocalCache();
+    //TestLocalCacheScan();
+    //TestLocalCacheBatch();
+    //TestCacheStats();
+    //TestCacheLoad();
     //TestExpireCache();
+    //TestTimingWheel();
+    //TestExpireCacheTtl();
+    //TestExpireScheduler();
+    //TestExpireCacheCleanup();
+    //TestExpireCacheBatch();
+    //TestExpireCacheCapacity();
+    //TestExpireCacheRefresh();
+    //TestCacheStorage();
+    //TestCacheHolder();
+    //TestLRUCache();
+    //TestLRUCacheWeight();
+    //TestShardedLRUCache();
+    //TestClockCache();
+    //TestReadBuffer();
+    //TestLRUAdmission();
+    //TestTieredLRUCache();
+    //TestSecondLevelOwnership();
+    //TestCacheSnapshot();
+    //TestCacheSnapshotCorrupt();
     //TestPhoneData();
     //TestRabbitMq();
     //TestDateTime();
@@ -0,0 +1,401 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+namespace cache
+{
+// 分层时间轮: 精度1毫秒, 第0层256个槽, 第1~4层各64个槽, 覆盖约49天, 更远的定时器按最远槽位处理, 到期后重新放置
+// 定时器节点放在连续的节点池里, 以下标作为句柄; 添加/取消都是O(1), 推进时每个定时器最多被降级4次
+// 降级按单个定时器计入Advance的limit, 同一槽位堆积大量定时器时也可以分多次完成
+// 非线程安全, 由调用方加锁
+template<class K>
+class TimingWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint32_t;
+    static const TimerId InvalidTimer = UINT32_MAX;
+
+    TimingWheel()
+    :
+    _start(Clock::now()),
+    _current(0),
+    _cascaded(0),
+    _size(0),
+    _free(InvalidTimer)
+    {
+        for (auto &slot : this->_slots)
+        {
+            slot = InvalidTimer;
+        }
+        for (auto &count : this->_counts)
+        {
+            count = 0;
+        }
+    }
+
+    size_t Size() const
+    {
+        return this->_size;
+    }
+
+    bool Empty() const
+    {
+        return this->_size == 0;
+    }
+
+    //添加定时器, 返回的句柄用于取消
+    TimerId Schedule(const K &key, Clock::time_point deadline)
+    {
+        TimerId id;
+        if (this->_free != InvalidTimer)
+        {
+            id = this->_free;
+            this->_free = this->_nodes[id].next;
+            this->_nodes[id].key = key;
+        }
+        else
+        {
+            id = static_cast<TimerId>(this->_nodes.size());
+            this->_nodes.push_back({key, 0, 0, InvalidTimer, InvalidTimer});
+        }
+        this->_nodes[id].tick = this->to_tick(deadline);
+        this->link(id);
+        this->_size++;
+        return id;
+    }
+
+    void Cancel(TimerId id)
+    {
+        this->unlink(id);
+        this->release(id);
+        this->_size--;
+    }
+
+    //推进到now, 对每个到期的定时器调用on_expire(key), 返回值为该key当前的过期时间
+    //返回值晚于now时原节点按新时间重新放置(句柄不变), 用于滑动过期的延迟顺延; 否则定时器结束
+    //每调用一次on_expire或降级一个定时器计1, 最多计limit; 返回实际计数, 小于limit说明已推进到now, 否则下次从中断处继续
+    template<class OnExpire>
+    size_t Advance(Clock::time_point now, const OnExpire &on_expire, size_t limit = SIZE_MAX)
+    {
+        auto target = this->elapsed(now);
+        size_t count = 0;
+        while (this->_current <= target)
+        {
+            if (this->_size == 0)
+            {
+                this->_current = target + 1;
+                break;
+            }
+            auto budget = limit - count;
+            auto cascaded = this->cascade(budget);
+            count = limit - budget;
+            if (!cascaded)
+            {
+                return count;
+            }
+            //第0层为空时直接跳到下一个需要降级的时刻
+            if (this->_counts[0] == 0)
+            {
+                auto next = this->next_cascade();
+                this->_current = next < target + 1 ? next : target + 1;
+                continue;
+            }
+            auto slot = static_cast<size_t>(this->_current & Level0Mask);
+            while (this->_slots[slot] != InvalidTimer)
+            {
+                if (count >= limit)
+                {
+                    return count;
+                }
+                auto id = this->_slots[slot];
+                this->unlink(id);
+                //超出覆盖范围的定时器被截断放置, 未真正到期时重新放置
+                if (this->_nodes[id].tick > this->_current)
+                {
+                    this->link(id);
+                    continue;
+                }
+                Clock::time_point deadline = on_expire(static_cast<const K &>(this->_nodes[id].key));
+                count++;
+                if (deadline > now)
+                {
+                    this->_nodes[id].tick = this->to_tick(deadline);
+                    this->link(id);
+                    continue;
+                }
+                this->_size--;
+                this->release(id);
+            }
+            this->_current++;
+        }
+        return count;
+    }
+
+    //下一次需要推进的时间: 当前时刻尚未完成的降级, 第0层最近的非空槽, 或下一个降级时刻; 为空时返回time_point::max()
+    //返回值可能早于真正的最早过期时间, 但不会晚于它
+    Clock::time_point NextExpiration() const
+    {
+        if (this->_size == 0)
+        {
+            return Clock::time_point::max();
+        }
+        //Advance恰好停在降级边界或在降级途中中断时, 当前时刻就需要推进
+        if (this->cascade_pending())
+        {
+            return this->_start + std::chrono::milliseconds(this->_current);
+        }
+        uint64_t next = this->next_cascade();
+        if (this->_counts[0] != 0)
+        {
+            auto boundary = (this->_current | Level0Mask) + 1;
+            for (auto tick = this->_current; tick < boundary; ++tick)
+            {
+                if (this->_slots[tick & Level0Mask] != InvalidTimer)
+                {
+                    next = tick;
+                    break;
+                }
+            }
+            next = next < boundary ? next : boundary;
+        }
+        return this->_start + std::chrono::milliseconds(next);
+    }
+
+    const K &Key(TimerId id) const
+    {
+        return this->_nodes[id].key;
+    }
+
+    //完成当前时刻尚未完成的降级: 当前时刻恰好是降级边界, 或Advance因limit中断在降级途中
+    //会移动定时器, 耗时与待降级的定时器数成正比; 每个定时器最多被降级4次, 总开销仍是均摊的
+    void FinishCascade()
+    {
+        size_t budget = SIZE_MAX;
+        this->cascade(budget);
+    }
+
+    //近似最早到期的定时器: 依次找第0层和各高层从当前位置起第一个非空槽, 槽内不排序; 为空时返回InvalidTimer
+    //高层槽位精度较粗, 结果可能比真正最早的定时器晚, 但扫描槽数有上限, 用于容量淘汰
+    //只查询不修改; 需先调用FinishCascade, 否则尚未降级的高层当前槽不在查找范围内
+    TimerId Earliest() const
+    {
+        if (this->_size == 0)
+        {
+            return InvalidTimer;
+        }
+        for (uint64_t tick = this->_current; this->_counts[0] != 0 && tick < this->_current + (1 << Level0Bits); ++tick)
+        {
+            if (this->_slots[tick & Level0Mask] != InvalidTimer)
+            {
+                return this->_slots[tick & Level0Mask];
+            }
+        }
+        for (size_t level = 1; level < Levels; ++level)
+        {
+            if (this->_counts[level] == 0)
+            {
+                continue;
+            }
+            auto position = this->_current >> shift(level);
+            for (uint64_t i = 1; i <= (1 << LevelBits); ++i)
+            {
+                auto slot = (1 << Level0Bits) + (level - 1) * (1 << LevelBits) + static_cast<size_t>((position + i) & LevelMask);
+                if (this->_slots[slot] != InvalidTimer)
+                {
+                    return this->_slots[slot];
+                }
+            }
+        }
+        return InvalidTimer;
+    }
+
+    void Clear()
+    {
+        this->_nodes.clear();
+        for (auto &slot : this->_slots)
+        {
+            slot = InvalidTimer;
+        }
+        for (auto &count : this->_counts)
+        {
+            count = 0;
+        }
+        this->_size = 0;
+        this->_free = InvalidTimer;
+    }
+
+private:
+    static const size_t Levels = 5;
+    static const size_t Level0Bits = 8;
+    static const size_t LevelBits = 6;
+    static const uint64_t Level0Mask = (1ULL << Level0Bits) - 1;
+    static const uint64_t LevelMask = (1ULL << LevelBits) - 1;
+    static const size_t SlotCount = (1 << Level0Bits) + (Levels - 1) * (1 << LevelBits);
+    static const uint64_t MaxDelta = (1ULL << (Level0Bits + (Levels - 1) * LevelBits)) - 1;
+
+    struct Node
+    {
+        K           key;
+        uint64_t    tick;
+        uint32_t    slot;
+        TimerId     prev;
+        TimerId     next;
+    };
+
+    //第level层每个槽覆盖的毫秒数取对数
+    static size_t shift(size_t level)
+    {
+        return level == 0 ? 0 : Level0Bits + (level - 1) * LevelBits;
+    }
+
+    uint64_t elapsed(Clock::time_point now) const
+    {
+        if (now <= this->_start)
+        {
+            return 0;
+        }
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - this->_start).count());
+    }
+
+    //向上取整, 保证不早于deadline触发
+    uint64_t to_tick(Clock::time_point deadline) const
+    {
+        if (deadline <= this->_start)
+        {
+            return 0;
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - this->_start).count();
+        return static_cast<uint64_t>((ns + 999999) / 1000000);
+    }
+
+    void link(TimerId id)
+    {
+        auto &node = this->_nodes[id];
+        auto tick = node.tick < this->_current ? this->_current : node.tick;
+        auto delta = tick - this->_current;
+        if (delta > MaxDelta)
+        {
+            delta = MaxDelta;
+            tick = this->_current + delta;
+        }
+        size_t level = 0;
+        while (level + 1 < Levels && delta >= (1ULL << shift(level + 1)))
+        {
+            level++;
+        }
+        size_t slot = level == 0
+            ? static_cast<size_t>(tick & Level0Mask)
+            : (1 << Level0Bits) + (level - 1) * (1 << LevelBits) + static_cast<size_t>((tick >> shift(level)) & LevelMask);
+        node.slot = static_cast<uint32_t>(slot);
+        node.prev = InvalidTimer;
+        node.next = this->_slots[slot];
+        if (node.next != InvalidTimer)
+        {
+            this->_nodes[node.next].prev = id;
+        }
+        this->_slots[slot] = id;
+        this->_counts[level]++;
+    }
+
+    void unlink(TimerId id)
+    {
+        auto &node = this->_nodes[id];
+        if (node.prev != InvalidTimer)
+        {
+            this->_nodes[node.prev].next = node.next;
+        }
+        else
+        {
+            this->_slots[node.slot] = node.next;
+        }
+        if (node.next != InvalidTimer)
+        {
+            this->_nodes[node.next].prev = node.prev;
+        }
+        this->_counts[level_of(node.slot)]--;
+    }
+
+    void release(TimerId id)
+    {
+        this->_nodes[id].next = this->_free;
+        this->_free = id;
+    }
+
+    static size_t level_of(uint32_t slot)
+    {
+        return slot < (1 << Level0Bits) ? 0 : 1 + (slot - (1 << Level0Bits)) / (1 << LevelBits);
+    }
+
+    //当前时刻是高层槽位的边界时, 从高到低把对应槽位的定时器逐个重新放置到低层, 每移动一个消耗1个budget
+    //budget用完时返回false, 已移动的保持在低层, 下次从剩下的继续; 边界时刻新加入的定时器不会落回当前槽
+    bool cascade(size_t &budget)
+    {
+        if (this->_cascaded > this->_current)
+        {
+            return true;
+        }
+        size_t top = 0;
+        while (top + 1 < Levels && (this->_current & ((1ULL << shift(top + 1)) - 1)) == 0)
+        {
+            top++;
+        }
+        for (size_t level = this->_current == 0 ? 0 : top; level > 0; --level)
+        {
+            auto slot = (1 << Level0Bits) + (level - 1) * (1 << LevelBits) + static_cast<size_t>((this->_current >> shift(level)) & LevelMask);
+            while (this->_slots[slot] != InvalidTimer)
+            {
+                if (budget == 0)
+                {
+                    return false;
+                }
+                budget--;
+                auto id = this->_slots[slot];
+                this->unlink(id);
+                this->link(id);
+            }
+        }
+        this->_cascaded = this->_current + 1;
+        return true;
+    }
+
+    //当前时刻是高层槽位的边界且还有定时器未降级
+    bool cascade_pending() const
+    {
+        if (this->_cascaded > this->_current || this->_current == 0 || (this->_current & Level0Mask) != 0)
+        {
+            return false;
+        }
+        for (size_t level = 1; level < Levels; ++level)
+        {
+            if (this->_counts[level] != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //最低非空层的下一个降级时刻
+    uint64_t next_cascade() const
+    {
+        size_t level = 1;
+        while (level + 1 < Levels && this->_counts[level] == 0)
+        {
+            level++;
+        }
+        auto span = 1ULL << shift(level);
+        return (this->_current / span + 1) * span;
+    }
+
+    Clock::time_point   _start;
+    uint64_t            _current;       //下一个待处理的tick, 之前的都已处理
+    uint64_t            _cascaded;      //之前的tick都已完成降级
+    size_t              _size;
+    TimerId             _free;          //空闲节点链表
+    std::vector<Node>   _nodes;
+    TimerId             _slots[SlotCount];
+    size_t              _counts[Levels];
+};
+}
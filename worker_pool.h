@@ -0,0 +1,104 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace cache
+{
+// 线程数固定上限的任务池, 排队任务数有上限; 队列已满时Submit返回false, 由调用方决定降级方式
+// 线程在提交任务且没有空闲线程时才创建, 不使用异步加载的进程不会多出线程
+// 用于缓存的异步加载和提前刷新, 大量key同时未命中或临近过期时不会每个key创建一个线程
+class WorkerPool
+{
+public:
+    using Task = std::function<void()>;
+    static const size_t DefaultThreads = 4;
+    static const size_t DefaultMaxPending = 1024;
+
+    explicit WorkerPool(size_t threads = DefaultThreads, size_t max_pending = DefaultMaxPending)
+    :
+    _max_threads(threads > 0 ? threads : 1),
+    _max_pending(max_pending > 0 ? max_pending : 1),
+    _idle(0),
+    _stopped(false)
+    {
+    }
+
+    //执行完已排队的任务后退出
+    ~WorkerPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_stopped = true;
+            this->_condition.notify_all();
+        }
+        for (auto &thread : this->_threads)
+        {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    bool Submit(Task task)
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        if (this->_stopped || this->_tasks.size() >= this->_max_pending)
+        {
+            return false;
+        }
+        this->_tasks.emplace_back(std::move(task));
+        if (this->_idle < this->_tasks.size() && this->_threads.size() < this->_max_threads)
+        {
+            this->_threads.emplace_back(&WorkerPool::run, this);
+        }
+        this->_condition.notify_one();
+        return true;
+    }
+
+    //进程内默认实例; 有意不析构, 保证静态缓存析构时仍在排队的加载可以执行完
+    static WorkerPool &Instance()
+    {
+        static WorkerPool *instance = new WorkerPool();
+        return *instance;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (true)
+        {
+            if (this->_tasks.empty())
+            {
+                if (this->_stopped)
+                {
+                    return;
+                }
+                this->_idle++;
+                this->_condition.wait(lock);
+                this->_idle--;
+                continue;
+            }
+            auto task = std::move(this->_tasks.front());
+            this->_tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    size_t                      _max_threads;
+    size_t                      _max_pending;
+    size_t                      _idle;          //正在等待任务的线程数
+    bool                        _stopped;
+    std::deque<Task>            _tasks;
+    std::mutex                  _mutex;
+    std::condition_variable     _condition;
+    std::vector<std::thread>    _threads;
+};
+}